@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2019, Northwestern University
+ * See COPYRIGHT notice in top-level directory.
+ *
+ * Types shared by the benchmarks (mpi_test.c, tam_test.c) and the communication methods of lustre_driver_test.c.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/* Phase times and counters of one method, a benchmark passes its own timer to collective_write.*/
+typedef struct{
+    double post_request_time;
+    double send_wait_all_time;
+    double recv_wait_all_time;
+    double barrier_time;
+    double total_time;
+    double io_time;
+    double setup_time;
+    double copy_time;
+    /* Exchange alone and compute alone of the overlap benchmark.*/
+    double comm_time;
+    double compute_time;
+    /* Overlap of the overlap benchmark on this process, and its minimum and mean over all processes.*/
+    double overlap;
+    double overlap_min;
+    double overlap_mean;
+    /* Per-process counts of the cost model: messages and bytes (the larger of sent and received), rounds and bytes copied by proxies, and the time they predict.*/
+    double messages;
+    double message_bytes;
+    double rounds;
+    double copy_bytes;
+    double model_time;
+    /* Fields from io_bytes on are summed over processes instead of maximized.*/
+    double io_bytes;
+    double corrupt_messages;
+    double corrupt_bytes;
+    double exchange_bytes;
+}Timer;
+
+/*
+    File layout and access pattern of the OST_STRIPE_MODEL setting.
+    1. stripe_size, stripe_count: Lustre striping of the file.
+    2. pattern: how a process lays out its nblocks blocks of blocklen bytes in the file (ACCESS_CONTIGUOUS, ACCESS_STRIDED or ACCESS_BLOCK_CYCLIC).
+    3. cyclic: number of consecutive blocks a process owns in every cycle of ACCESS_BLOCK_CYCLIC.
+*/
+typedef struct{
+    int stripe_size;
+    int stripe_count;
+    int pattern;
+    int blocklen;
+    int nblocks;
+    int cyclic;
+}Stripe_model;
+
+#endif
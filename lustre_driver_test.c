@@ -1,8 +1,12 @@
+#define _GNU_SOURCE /* sched_getcpu() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <mpi.h>
-#include <unistd.h> /* getopt() */
+#include <sys/mman.h> /* mmap() */
+#include <sched.h> /* sched_getcpu() */
+#include "benchmark.h"
 
 #define ADIOI_Calloc calloc
 #define ADIOI_Malloc malloc
@@ -11,7 +15,31 @@
 #define OST_STRIPE_GREATER 1
 #define OST_STRIPE_LESS 2
 #define OST_STRIPE_ALL 3
+#define OST_STRIPE_MODEL 4
+#define NODE_ASSIGNMENT_NUMA 2
+#define ACCESS_CONTIGUOUS 0
+#define ACCESS_STRIDED 1
+#define ACCESS_BLOCK_CYCLIC 2
 #define DEBUG 0
+#define COMM_BUF_MALLOC 0
+#define COMM_BUF_ALLOC_MEM 1
+#define COMM_BUF_HUGEPAGE 2
+#define COMM_BUF_POOL 3
+/* Levels of collective_write_hierarchical, also bounds its tags.*/
+#define HIER_MAX_LEVELS 8
+/* Ping-pong that measures the injection bandwidth and the message latency for auto_local_aggregators.*/
+#define INJECTION_PROBE_BYTES 1048576
+#define INJECTION_PROBE_REPS 8
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE 2097152
+#endif
+/* Messages above LARGE_COUNT_LIMIT bytes are described by a derived datatype of LARGE_COUNT_CHUNK byte blocks when MPI_Issend_c is not available.*/
+#ifndef LARGE_COUNT_LIMIT
+#define LARGE_COUNT_LIMIT INT_MAX
+#endif
+#ifndef LARGE_COUNT_CHUNK
+#define LARGE_COUNT_CHUNK 1073741824
+#endif
 /*
     1. a: sender rank
     2. b: receiver_rank
@@ -19,40 +47,167 @@
 */
 #define MAP_DATA(a,b,c) (1+(a)*3+(b)*5+(c)*7)
 
-typedef struct{
-    double post_request_time;
-    double send_wait_all_time;
-    double recv_wait_all_time;
-    double total_time;
-}Timer;
-
-
-/*----< usage() >------------------------------------------------------------*/
-#if DEBUG==1
-static void
-usage()
-{
-    char *help =
-    "Usage: %s [OPTION]... [FILE]...\n"
-    "       [-h] Print help\n"
-    "       [-p] number of MPI processes per node\n"
-    "       [-b] message block unit size\n"
-    "       [-n] number of iterations\n"
-    "       [-t] test type (0-2)\n";
-    printf("%s",help);
+/* Number of OpenMP threads a TAM proxy uses to pack and unpack the aggregated messages.*/
+int tam_copy_threads = 1;
+/* NUMA domains per node of NODE_ASSIGNMENT_NUMA, 0: one domain per node, -1: read the domain of every process from sysfs.*/
+int tam_numa_domains = 0;
+/* When set, the proxy unpacks the message of every node as soon as it arrives (MPI_Waitsome) instead of after the whole exchange.*/
+int tam_waitsome = 0;
+/* When set, collective_write gathers and exchanges its sizes with collectives on the cached node and proxy communicators instead of point-to-point.*/
+int tam_meta_collective = 0;
+/* Cost model of auto_local_aggregators: injection bandwidth of one process and of a whole node in bytes per second (0: measured).*/
+double tam_injection_bandwidth = 0;
+double tam_nic_bandwidth = 0;
+
+/*
+    Allocator of the communication buffers (comm_buf_alloc, comm_buf_free), shared with mpi_test.c.
+    1. COMM_BUF_MALLOC: malloc.
+    2. COMM_BUF_ALLOC_MEM: MPI_Alloc_mem, memory the MPI library may register in advance.
+    3. COMM_BUF_HUGEPAGE: mmap with MAP_HUGETLB, or with transparent huge pages (madvise) when no huge pages are reserved.
+    4. COMM_BUF_POOL: freed buffers are kept and handed out again (first fit), so later experiments reuse pages that are already registered.
+    Every buffer is preceded by a 64-byte header that records how it was allocated.
+*/
+int comm_buf_mode = COMM_BUF_MALLOC;
+/* When set, comm_buf_alloc writes every new buffer once, so its pages are placed in the NUMA domain of the allocating process (first touch).*/
+int comm_buf_first_touch = 0;
+/* Seconds spent in those first-touch writes, so that callers can keep them out of a timed exchange.*/
+double comm_buf_touch_time = 0;
+
+typedef union Comm_buf_header{
+    struct{
+        MPI_Aint capacity;
+        int mode;
+        union Comm_buf_header *next;
+    }h;
+    char pad[64];
+}Comm_buf_header;
+
+static Comm_buf_header *comm_buf_pool = NULL;
+
+char *comm_buf_alloc(MPI_Aint size){
+    Comm_buf_header *header = NULL, **prev;
+    MPI_Aint capacity = size + (MPI_Aint) sizeof(Comm_buf_header);
+    int mode = comm_buf_mode;
+    double start;
+    void *ptr;
+    if (mode == COMM_BUF_POOL){
+        for ( prev = &comm_buf_pool; *prev; prev = &((*prev)->h.next) ){
+            if ((*prev)->h.capacity >= capacity){
+                header = *prev;
+                *prev = header->h.next;
+                return (char*) (header + 1);
+            }
+        }
+        mode = COMM_BUF_MALLOC;
+    }
+    if (mode == COMM_BUF_ALLOC_MEM){
+        if (MPI_Alloc_mem(capacity, MPI_INFO_NULL, &header) != MPI_SUCCESS){
+            header = NULL;
+        }
+    } else if (mode == COMM_BUF_HUGEPAGE){
+        capacity = (capacity + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        ptr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED){
+            ptr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            #ifdef MADV_HUGEPAGE
+            if (ptr != MAP_FAILED){
+                madvise(ptr, capacity, MADV_HUGEPAGE);
+            }
+            #endif
+        }
+        if (ptr != MAP_FAILED){
+            header = (Comm_buf_header*) ptr;
+        }
+    } else {
+        header = (Comm_buf_header*) ADIOI_Malloc(capacity);
+    }
+    if (header == NULL){
+        printf("failed to allocate a communication buffer of %lld bytes (mode %d)\n", (long long) size, mode);
+        return NULL;
+    }
+    header->h.capacity = capacity;
+    header->h.mode = mode;
+    header->h.next = NULL;
+    if (comm_buf_first_touch){
+        start = MPI_Wtime();
+        memset(header + 1, 0, size);
+        comm_buf_touch_time += MPI_Wtime() - start;
+    }
+    return (char*) (header + 1);
+}
+
+static void comm_buf_unmap(Comm_buf_header *header){
+    if (header->h.mode == COMM_BUF_ALLOC_MEM){
+        MPI_Free_mem(header);
+    } else if (header->h.mode == COMM_BUF_HUGEPAGE){
+        munmap(header, header->h.capacity);
+    } else {
+        ADIOI_Free(header);
+    }
+}
+
+void comm_buf_free(char *buf){
+    Comm_buf_header *header;
+    if (buf == NULL){
+        return;
+    }
+    header = (Comm_buf_header*) buf - 1;
+    if (comm_buf_mode == COMM_BUF_POOL){
+        header->h.next = comm_buf_pool;
+        comm_buf_pool = header;
+        return;
+    }
+    comm_buf_unmap(header);
+}
+
+/* Return the buffers cached by COMM_BUF_POOL, must be called before MPI_Finalize.*/
+int comm_buf_release(){
+    Comm_buf_header *header;
+    while (comm_buf_pool){
+        header = comm_buf_pool;
+        comm_buf_pool = header->h.next;
+        comm_buf_unmap(header);
+    }
+    return 0;
+}
+
+/*
+    MAP_DATA advances by 7 for every byte, so a message is a window of this table: since 7 * 183 = 1 (mod 256), byte c of a message from a to b
+    equals map_table[(183 * (1 + 3a + 5b) + c) % 256]. Messages are compared 256 bytes at a time and only a differing window is inspected per byte.
+*/
+static char map_table[512];
+
+static void map_table_init(){
+    static int initialized = 0;
+    int i;
+    if (initialized){
+        return;
+    }
+    for ( i = 0; i < 512; i++ ){
+        map_table[i] = (char) (i * 7);
+    }
+    initialized = 1;
 }
-#endif
 
 int test_correctness(int rank, int nprocs, int* recv_size, char **recv_buf){
-    int i,j;
+    int i, j, n, k, offset, wrong;
     int result = 1;
+    map_table_init();
     for ( i = 0; i < nprocs; i++ ){
-        for ( j = 0; j < recv_size[i]; j++ ){
-            if ((int)recv_buf[i][j]!=(int)((char)MAP_DATA(i,rank,j))){
-                printf("unexpected result at aggregator %d from %d, %d!=%d\n", rank, i, (int)recv_buf[i][j], (int)((char)MAP_DATA(i,rank,j)));
-                result = 0;
+        wrong = 0;
+        for ( j = 0; j < recv_size[i]; j += n ){
+            n = recv_size[i] - j < 256 ? recv_size[i] - j : 256;
+            offset = (int) ((183u * (unsigned) MAP_DATA(i,rank,0) + (unsigned) j) & 255);
+            if (memcmp(recv_buf[i] + j, map_table + offset, n)){
+                for ( k = 0; k < n; k++ ){
+                    wrong += recv_buf[i][j + k] != map_table[offset + k];
+                }
             }
         }
+        if (wrong){
+            printf("unexpected result at aggregator %d from %d, %d of %d bytes are wrong\n", rank, i, wrong, recv_size[i]);
+            result = 0;
+        }
     }
     return result;
 }
@@ -76,7 +231,8 @@ void stringSort(char *arr[], int n)
      5. global_aggregator_size: size of global_aggregators.
      6. global_aggregators: an array of all aggregators.
      7. co: number of local aggregators per node.
-     8 mode: 0: local aggregaotrs are evenly spreadout on a node, 1: local aggregators try to occupy the superset of global aggregators
+     8. co_node: number of local aggregators of every node (size nrecvs, see auto_local_aggregators). If it is not NULL, it replaces co.
+     9. mode: 0: local aggregaotrs are evenly spreadout on a node, 1: local aggregators try to occupy the superset of global aggregators
   Output:
      1. is_aggregator_new: if this process is an aggregator in new context.
      2. local_aggregator_size: length of local_aggregators
@@ -85,7 +241,7 @@ void stringSort(char *arr[], int n)
      5. aggregator_local_ranks: an array that tells what ranks this aggregator is responsible for performing proxy communication. (only significant if this process is an aggregator)
      6. aggregator_process_list: mapping from a process rank to the aggregator responsible for sending its data to other aggregators.
 */
-int aggregator_meta_information(int rank, int *process_node_list, int nprocs, int nrecvs, int global_aggregator_size, int *global_aggregators, int co, int* is_aggregator_new, int* local_aggregator_size, int **local_aggregators, int* nprocs_aggregator, int **aggregator_local_ranks, int **process_aggregator_list, int mode){
+int aggregator_meta_information(int rank, int *process_node_list, int nprocs, int nrecvs, int global_aggregator_size, int *global_aggregators, int co, int *co_node, int* is_aggregator_new, int* local_aggregator_size, int **local_aggregators, int* nprocs_aggregator, int **aggregator_local_ranks, int **process_aggregator_list, int mode){
     int i, j, k, local_node_aggregator_size, local_node_process_size, *local_node_aggregators, *temp_local_ranks, *check_local_aggregators, *check_global_aggregators, temp1, temp2, temp3, base, remainder, co2, test, *ptr;
     process_aggregator_list[0] = (int*) ADIOI_Malloc(sizeof(int)*nprocs);
     local_node_aggregators = (int*) ADIOI_Malloc(sizeof(int)*nprocs);
@@ -112,10 +268,11 @@ int aggregator_meta_information(int rank, int *process_node_list, int nprocs, in
                 local_node_process_size++;
             }
         }
-        if ( co > local_node_process_size ){
+        co2 = co_node ? co_node[i] : co;
+        if ( co2 > local_node_process_size ){
             local_aggregator_size[0] += local_node_process_size;
         }else{
-            local_aggregator_size[0] += co;
+            local_aggregator_size[0] += co2;
         }
     }
     local_aggregators[0] = (int*) ADIOI_Malloc(local_aggregator_size[0]*sizeof(int));
@@ -136,10 +293,9 @@ int aggregator_meta_information(int rank, int *process_node_list, int nprocs, in
             }
         }
         /* Work out maximum number of intranode aggregator per node*/
-        if( co > local_node_process_size){
+        co2 = co_node ? co_node[i] : co;
+        if( co2 > local_node_process_size){
             co2 = local_node_process_size;
-        } else{
-            co2 = co;
         }
         if (mode){
             if ( co2 > local_node_aggregator_size ){
@@ -251,6 +407,190 @@ int aggregator_meta_information(int rank, int *process_node_list, int nprocs, in
     return 0;
 }
 
+/*
+  Ping-pong between the lowest rank of node 0 and the lowest rank of another node (or any other process if there is one node).
+  Output: bandwidth in bytes per second and latency per message in seconds, the same on all processes.
+*/
+static int measure_injection(int rank, int nprocs, int *process_node_list, MPI_Comm comm, double *bandwidth, double *latency){
+    int i, peer = -1, ping = 0, pong = -1;
+    double result[2] = {0, 0}, start;
+    char *buf;
+    for ( i = 1; i < nprocs; ++i ){
+        if ( process_node_list[i] != process_node_list[0] ){
+            pong = i;
+            break;
+        }
+    }
+    if ( pong < 0 && nprocs > 1 ){
+        pong = 1;
+    }
+    if ( rank == ping ){
+        peer = pong;
+    } else if ( rank == pong ){
+        peer = ping;
+    }
+    if ( peer >= 0 ){
+        buf = (char*) ADIOI_Calloc(INJECTION_PROBE_BYTES, sizeof(char));
+        MPI_Sendrecv(buf, 0, MPI_BYTE, peer, 0, buf, 0, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+        start = MPI_Wtime();
+        for ( i = 0; i < INJECTION_PROBE_REPS; ++i ){
+            if ( rank == ping ){
+                MPI_Send(buf, 0, MPI_BYTE, peer, 0, comm);
+                MPI_Recv(buf, 0, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+            } else{
+                MPI_Recv(buf, 0, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+                MPI_Send(buf, 0, MPI_BYTE, peer, 0, comm);
+            }
+        }
+        result[1] = (MPI_Wtime() - start) / (2 * INJECTION_PROBE_REPS);
+        start = MPI_Wtime();
+        for ( i = 0; i < INJECTION_PROBE_REPS; ++i ){
+            if ( rank == ping ){
+                MPI_Send(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm);
+                MPI_Recv(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+            } else{
+                MPI_Recv(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+                MPI_Send(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm);
+            }
+        }
+        start = (MPI_Wtime() - start) / (2 * INJECTION_PROBE_REPS) - result[1];
+        result[0] = start > 0 ? INJECTION_PROBE_BYTES / start : 0;
+        ADIOI_Free(buf);
+    }
+    MPI_Bcast(result, 2, MPI_DOUBLE, ping, comm);
+    bandwidth[0] = result[0];
+    latency[0] = result[1];
+    return 0;
+}
+
+/*
+  Node injection limit for auto_local_aggregators: the k-th process of the first node streams to the k-th process of the next node, for every k
+  that has a partner, all at once. The bytes moved over the time of the slowest pair approximate what the NIC of a node sustains. 0 without a
+  second node. Collective over comm.
+*/
+static int measure_node_injection(int rank, int nprocs, int *process_node_list, MPI_Comm comm, double *nic_bandwidth){
+    int i, k, pairs, peer = -1, node_a = process_node_list[0], node_b = -1, index_a = 0, index_b = 0, my_index = -1;
+    double start, elapsed = 0;
+    char *buf;
+    for ( i = 0; i < nprocs; ++i ){
+        if ( node_b < 0 && process_node_list[i] != node_a ){
+            node_b = process_node_list[i];
+        }
+    }
+    nic_bandwidth[0] = 0;
+    if ( node_b < 0 ){
+        return 0;
+    }
+    for ( i = 0; i < nprocs; ++i ){
+        if ( i == rank ){
+            my_index = process_node_list[i] == node_a ? index_a : index_b;
+        }
+        index_a += process_node_list[i] == node_a;
+        index_b += process_node_list[i] == node_b;
+    }
+    pairs = index_a < index_b ? index_a : index_b;
+    if ( (process_node_list[rank] == node_a || process_node_list[rank] == node_b) && my_index < pairs ){
+        /* The partner is the process with the same index on the other node.*/
+        for ( i = 0, k = 0; i < nprocs; ++i ){
+            if ( process_node_list[i] == (process_node_list[rank] == node_a ? node_b : node_a) && k++ == my_index ){
+                peer = i;
+                break;
+            }
+        }
+    }
+    buf = peer >= 0 ? (char*) ADIOI_Calloc(INJECTION_PROBE_BYTES, sizeof(char)) : NULL;
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    if ( peer >= 0 ){
+        for ( i = 0; i < INJECTION_PROBE_REPS; ++i ){
+            if ( process_node_list[rank] == node_a ){
+                MPI_Send(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm);
+            } else{
+                MPI_Recv(buf, INJECTION_PROBE_BYTES, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+            }
+        }
+        /* A zero-byte acknowledgement ends the timing at the sender once everything has arrived.*/
+        if ( process_node_list[rank] == node_a ){
+            MPI_Recv(buf, 0, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+        } else{
+            MPI_Send(buf, 0, MPI_BYTE, peer, 0, comm);
+        }
+        elapsed = MPI_Wtime() - start;
+        ADIOI_Free(buf);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm);
+    if ( elapsed > 0 ){
+        nic_bandwidth[0] = (double) pairs * INJECTION_PROBE_REPS * INJECTION_PROBE_BYTES / elapsed;
+    }
+    return 0;
+}
+
+/*
+  Chooses the number of local aggregators (co) of every node from its outgoing traffic, for aggregator_meta_information.
+  The bytes B and the number of messages M that the processes of a node send to other nodes are summed over the node. With c local aggregators the node is predicted to need
+     T(c) = B / min(c * bandwidth, nic_bandwidth) + latency * (M / c + c)
+  The first term is the injection time, which more aggregators shorten until the NIC limit (tam_nic_bandwidth) is reached. The second term is the messages each aggregator posts plus the intra-node gather, which grows with c.
+  The c in [1, node size] with the lowest T is chosen, so nodes with heavier outgoing traffic get more local aggregators.
+  bandwidth is tam_injection_bandwidth, the latency and (if tam_injection_bandwidth is 0) the bandwidth are measured by a ping-pong. nic_bandwidth is
+  tam_nic_bandwidth, or measured with every process of a node injecting at once if it is 0 (see measure_node_injection). Collective over comm.
+  Input:
+     1. rank: rank of this process.
+     2. nprocs: total number of process.
+     3. nrecvs: total number of nodes.
+     4. process_node_list: a mapping from a process to the node index it belongs to.
+     5. send_size: bytes this process sends to every process.
+  Output:
+     1. co_node: number of local aggregators of every node (size nrecvs).
+*/
+int auto_local_aggregators(int rank, int nprocs, int nrecvs, int *process_node_list, int *send_size, MPI_Comm comm, int **co_node){
+    int i, c, local_node_process_size;
+    double *node_traffic, bandwidth, latency, nic_bandwidth, rate, cost, best;
+    node_traffic = (double*) ADIOI_Calloc(2 * nrecvs, sizeof(double));
+    for ( i = 0; i < nprocs; ++i ){
+        if ( process_node_list[i] != process_node_list[rank] && send_size[i] ){
+            node_traffic[2 * process_node_list[rank]] += send_size[i];
+            node_traffic[2 * process_node_list[rank] + 1]++;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, node_traffic, 2 * nrecvs, MPI_DOUBLE, MPI_SUM, comm);
+    measure_injection(rank, nprocs, process_node_list, comm, &bandwidth, &latency);
+    if ( tam_injection_bandwidth > 0 ){
+        bandwidth = tam_injection_bandwidth;
+    }
+    nic_bandwidth = tam_nic_bandwidth;
+    if ( nic_bandwidth <= 0 ){
+        measure_node_injection(rank, nprocs, process_node_list, comm, &nic_bandwidth);
+    }
+    if ( rank == 0 ){
+        printf("local aggregator model: injection bandwidth = %.2f MiB/s, node limit = %.2f MiB/s, latency = %.2f us\n", bandwidth / 1048576, nic_bandwidth / 1048576, latency * 1e6);
+    }
+    co_node[0] = (int*) ADIOI_Malloc(sizeof(int) * nrecvs);
+    for ( i = 0; i < nrecvs; ++i ){
+        local_node_process_size = 0;
+        for ( c = 0; c < nprocs; ++c ){
+            local_node_process_size += process_node_list[c] == i;
+        }
+        co_node[0][i] = 1;
+        best = -1;
+        for ( c = 1; c <= local_node_process_size && bandwidth > 0 && node_traffic[2 * i] > 0; ++c ){
+            rate = c * bandwidth;
+            if ( nic_bandwidth > 0 && rate > nic_bandwidth ){
+                rate = nic_bandwidth;
+            }
+            cost = node_traffic[2 * i] / rate + latency * (node_traffic[2 * i + 1] / c + c);
+            if ( best < 0 || cost < best ){
+                best = cost;
+                co_node[0][i] = c;
+            }
+        }
+        if ( rank == 0 ){
+            printf("node %d: %d processes, %.0f bytes in %.0f messages to other nodes, co = %d\n", i, local_node_process_size, node_traffic[2 * i], node_traffic[2 * i + 1], co_node[0][i]);
+        }
+    }
+    ADIOI_Free(node_traffic);
+    return 0;
+}
+
 /*
   Input:
        1. rank: process rank with respect to communicator comm.
@@ -356,11 +696,115 @@ int gather_node_information(int rank, int nprocs,int *nprocs_node,int *nrecvs, i
        5. global_receivers: An array (size nrecvs) that contains the ranks of proxy processes with respect to communicator comm.
        6. process_node_list : An array (size nprocs) that maps a process to a node (the node index correspond to the order of global receivers)
 */
+/*
+  NUMA domain of the CPU this process runs on, from /sys/devices/system/node/node<n>/cpulist. Only meaningful if processes are bound to cores.
+*/
+static int numa_domain_of_self(){
+    char path[64], list[4096], *token, *saveptr = NULL;
+    FILE *stream;
+    int node, cpu = sched_getcpu(), first, last;
+    if (cpu < 0){
+        return 0;
+    }
+    for ( node = 0; ; node++ ){
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        stream = fopen(path, "r");
+        if (stream == NULL){
+            break;
+        }
+        if (fgets(list, sizeof(list), stream) == NULL){
+            list[0] = '\0';
+        }
+        fclose(stream);
+        for ( token = strtok_r(list, ",\n", &saveptr); token; token = strtok_r(NULL, ",\n", &saveptr) ){
+            if (sscanf(token, "%d-%d", &first, &last) == 1){
+                last = first;
+            }
+            if (cpu >= first && cpu <= last){
+                return node;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+  Every node (nprocs_node consecutive ranks) is split into its NUMA domains, and every domain is treated as a node of its own with its own proxy
+  (the lowest rank of the domain). Domains are read from sysfs (tam_numa_domains < 0) or emulated by cutting the node into tam_numa_domains
+  equal parts. Collective, the outputs are the same as those of static_node_assignment.
+*/
+static int numa_node_assignment(int rank, int nprocs, int *nprocs_node,int *nrecvs, int** node_size, int** local_ranks, int** global_receivers, int **process_node_list){
+    int i, j, d, node, nnodes, ppn = nprocs_node[0], size, ndomains, *domains, *first;
+    domains = (int*) ADIOI_Malloc(sizeof(int) * nprocs);
+    if (tam_numa_domains < 0){
+        d = numa_domain_of_self();
+    } else {
+        size = rank / ppn == (nprocs - 1) / ppn ? nprocs - rank / ppn * ppn : ppn;
+        d = (rank % ppn) * tam_numa_domains / size;
+    }
+    MPI_Allgather(&d, 1, MPI_INT, domains, 1, MPI_INT, MPI_COMM_WORLD);
+    /* Number the (node, domain) pairs in order, domains of a node in increasing order.*/
+    ndomains = 0;
+    for ( i = 0; i < nprocs; i++ ){
+        if (domains[i] + 1 > ndomains){
+            ndomains = domains[i] + 1;
+        }
+    }
+    nnodes = (nprocs + ppn - 1) / ppn;
+    first = (int*) ADIOI_Malloc(sizeof(int) * ndomains);
+    process_node_list[0] = (int*) ADIOI_Malloc(sizeof(int) * nprocs);
+    global_receivers[0] = (int*) ADIOI_Malloc(sizeof(int) * nnodes * ndomains);
+    node_size[0] = (int*) ADIOI_Malloc(sizeof(int) * nnodes * ndomains);
+    nrecvs[0] = 0;
+    for ( node = 0; node < nnodes; node++ ){
+        for ( d = 0; d < ndomains; d++ ){
+            first[d] = -1;
+        }
+        for ( i = node * ppn; i < nprocs && i < (node + 1) * ppn; i++ ){
+            if (first[domains[i]] < 0){
+                first[domains[i]] = i;
+            }
+        }
+        for ( d = 0; d < ndomains; d++ ){
+            if (first[d] < 0){
+                continue;
+            }
+            global_receivers[0][nrecvs[0]] = first[d];
+            node_size[0][nrecvs[0]] = 0;
+            for ( i = first[d]; i < nprocs && i < (node + 1) * ppn; i++ ){
+                if (domains[i] == d){
+                    process_node_list[0][i] = nrecvs[0];
+                    node_size[0][nrecvs[0]]++;
+                }
+            }
+            nrecvs[0]++;
+        }
+    }
+    nprocs_node[0] = node_size[0][process_node_list[0][rank]];
+    local_ranks[0] = (int*) ADIOI_Malloc(sizeof(int) * nprocs_node[0]);
+    j = 0;
+    for ( i = rank / ppn * ppn; i < nprocs && i < (rank / ppn + 1) * ppn; i++ ){
+        if (process_node_list[0][i] == process_node_list[0][rank]){
+            local_ranks[0][j++] = i;
+        }
+    }
+    ADIOI_Free(first);
+    ADIOI_Free(domains);
+    return 0;
+}
+
 int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int *nrecvs, int** node_size, int** local_ranks, int** global_receivers, int **process_node_list){
     int i, remainder, temp, shift;
     if ( rank == 0 ){
         printf("static node assignment for %d node ( %d processes per node) of type %d\n", nprocs, nprocs_node[0], type );
     }
+    if (type == NODE_ASSIGNMENT_NUMA){
+        numa_node_assignment(rank, nprocs, nprocs_node, nrecvs, node_size, local_ranks, global_receivers, process_node_list);
+        if ( rank == 0 ){
+            printf("NUMA node assignment: %d proxies\n", nrecvs[0]);
+        }
+        return 0;
+    }
     if (type == 1){
         nrecvs[0] = (nprocs+nprocs_node[0]-1)/nprocs_node[0];
         local_ranks[0] = (int*) ADIOI_Malloc(sizeof(int) * nprocs_node[0]);
@@ -428,6 +872,97 @@ int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int
     return 0;
 }
 
+/*
+  Number of aggregators ROMIO's Lustre driver actually uses for cb_nodes requested aggregators: a multiple of stripe_count if cb_nodes is at least
+  stripe_count, otherwise the largest divisor of stripe_count that does not exceed cb_nodes. This keeps every OST served by the same aggregators.
+*/
+int stripe_model_aggregators(int cb_nodes, int stripe_count){
+    int avail_cb_nodes;
+    if (cb_nodes >= stripe_count){
+        return cb_nodes - cb_nodes % stripe_count;
+    }
+    for ( avail_cb_nodes = cb_nodes; avail_cb_nodes > 1; avail_cb_nodes-- ){
+        if (stripe_count % avail_cb_nodes == 0){
+            break;
+        }
+    }
+    return avail_cb_nodes;
+}
+
+/*
+  File offset of block k of process rank under the access pattern of the model. Strided is block-cyclic with one block per cycle and contiguous is
+  block-cyclic with all blocks in one cycle.
+*/
+static MPI_Offset stripe_model_offset(int rank, int nprocs, int k, Stripe_model *model){
+    int cyclic;
+    switch (model->pattern) {
+        case ACCESS_STRIDED :
+            cyclic = 1;
+            break;
+        case ACCESS_BLOCK_CYCLIC :
+            cyclic = model->cyclic > 0 ? model->cyclic : 1;
+            break;
+        default :
+            cyclic = model->nblocks;
+            break;
+    }
+    return (((MPI_Offset) (k / cyclic) * nprocs + rank) * cyclic + k % cyclic) * model->blocklen;
+}
+
+/*
+  Walk the blocks of process rank and add the bytes that fall into the file domain of every aggregator. Stripe j belongs to aggregator
+  j % avail_cb_nodes. If agg_index is not negative, only that aggregator is accumulated into sizes[0], otherwise sizes has avail_cb_nodes entries.
+*/
+static int stripe_model_walk(int rank, int nprocs, int avail_cb_nodes, int agg_index, Stripe_model *model, int *sizes){
+    MPI_Offset offset, end, stripe_end;
+    int k, owner;
+    for ( k = 0; k < model->nblocks; k++ ){
+        offset = stripe_model_offset(rank, nprocs, k, model);
+        end = offset + model->blocklen;
+        while (offset < end){
+            stripe_end = (offset / model->stripe_size + 1) * model->stripe_size;
+            if (stripe_end > end){
+                stripe_end = end;
+            }
+            owner = (int) ((offset / model->stripe_size) % avail_cb_nodes);
+            if (agg_index < 0){
+                sizes[owner] += (int) (stripe_end - offset);
+            } else if (owner == agg_index){
+                sizes[0] += (int) (stripe_end - offset);
+            }
+            offset = stripe_end;
+        }
+    }
+    return 0;
+}
+
+/*
+  Derive message sizes from the file offsets every process touches, the way ROMIO's Lustre driver builds its requests.
+  Input:
+       1. rank: process rank
+       2. nprocs: total number of processes
+       3. avail_cb_nodes: number of aggregators (see stripe_model_aggregators)
+       4. agg_index: position of this process in the aggregator list, negative if it is not an aggregator.
+       5. model: file layout and access pattern.
+  Output:
+       1. send_size: An array (size avail_cb_nodes) of bytes this process sends to every aggregator.
+       2. recv_size: An array (size nprocs) of bytes this aggregator receives from every process (only significant if agg_index is not negative).
+*/
+int stripe_model_sizes(int rank, int nprocs, int avail_cb_nodes, int agg_index, Stripe_model *model, int *send_size, int *recv_size){
+    int i;
+    for ( i = 0; i < avail_cb_nodes; i++ ){
+        send_size[i] = 0;
+    }
+    stripe_model_walk(rank, nprocs, avail_cb_nodes, -1, model, send_size);
+    if (agg_index >= 0){
+        for ( i = 0; i < nprocs; i++ ){
+            recv_size[i] = 0;
+            stripe_model_walk(i, nprocs, avail_cb_nodes, agg_index, model, recv_size + i);
+        }
+    }
+    return 0;
+}
+
 /*
   Input:
        1. rank: process rank
@@ -437,6 +972,8 @@ int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int
        5. nrecvs: size of global_receivers
        6. blocklen: message size unit
        7. type : Which pattern to be tested.
+       8. model : File layout and access pattern of OST_STRIPE_MODEL (ignored by the other types). One aggregator per node is requested and
+                  trimmed by stripe_model_aggregators; blocklen is taken from the model.
   Output:
        1. recv_size : An array (size nprocs) tells the size of messages to be received from the rest of processes.
        2. send_size : An array (size nprocs) tells the size of messages to be sent to the rest of processes.
@@ -444,8 +981,8 @@ int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int
        4. send_buf : An array of send buffer pointers (of size nprocs) for this process.
 */
 
-int initialize_setting(int rank, int nprocs, int *local_ranks, int *global_receivers, int nrecvs, int blocklen, int **recv_size, int **send_size, char ***recv_buf, char ***send_buf, int** global_aggregators, int *global_aggregator_size, int* is_aggregator, int type){
-    int i, j;
+int initialize_setting(int rank, int nprocs, int *local_ranks, int *global_receivers, int nrecvs, int blocklen, int **recv_size, int **send_size, char ***recv_buf, char ***send_buf, int** global_aggregators, int *global_aggregator_size, int* is_aggregator, int type, Stripe_model *model){
+    int i, j, agg_index = -1, *agg_size;
     send_size[0] = (int*) ADIOI_Calloc(nprocs, sizeof(int));
     recv_size[0] = (int*) ADIOI_Calloc(nprocs, sizeof(int));
     recv_buf[0] = (char**) ADIOI_Calloc(nprocs, sizeof(char*));
@@ -544,6 +1081,36 @@ int initialize_setting(int rank, int nprocs, int *local_ranks, int *global_recei
                 }
             }
             break;
+        case OST_STRIPE_MODEL :
+            global_aggregator_size[0] = stripe_model_aggregators(nrecvs, model->stripe_count);
+            global_aggregators[0] = (int*) ADIOI_Calloc(global_aggregator_size[0], sizeof(int));
+            for ( i = 0; i < global_aggregator_size[0]; i++ ){
+                global_aggregators[0][i] = global_receivers[i];
+                if ( rank == global_aggregators[0][i] ){
+                    is_aggregator[0] = 1;
+                    agg_index = i;
+                }
+            }
+            agg_size = (int*) ADIOI_Malloc(sizeof(int) * global_aggregator_size[0]);
+            stripe_model_sizes(rank, nprocs, global_aggregator_size[0], agg_index, model, agg_size, recv_size[0]);
+            if (is_aggregator[0]){
+                for ( i = 0; i < nprocs; i++ ){
+                    if (recv_size[0][i]){
+                        recv_buf[0][i] = (char*) ADIOI_Calloc(recv_size[0][i], sizeof(char));
+                    }
+                }
+            }
+            for ( i = 0; i < global_aggregator_size[0]; i++ ){
+                send_size[0][global_aggregators[0][i]] = agg_size[i];
+                if (agg_size[i]){
+                    send_buf[0][global_aggregators[0][i]] = (char*) ADIOI_Calloc(agg_size[i], sizeof(char));
+                }
+                for ( j = 0; j < agg_size[i]; j++ ){
+                    send_buf[0][global_aggregators[0][i]][j] = MAP_DATA(rank,global_aggregators[0][i],j);
+                }
+            }
+            ADIOI_Free(agg_size);
+            break;
     }
     return 0;
 }
@@ -686,11 +1253,11 @@ int collective_write3(int myrank, int nprocs, int local_aggregator_size, int is_
                 // Recall that local_lens is inclusive prefix sum of send length.
                 if ( w == 0 && local_aggregators[i] == 0 ){
                     array_of_blocklengths[w] = local_lens[w * nprocs + local_aggregators[i]];
-                    MPI_Address(aggregate_buf + sizeof(int) * nprocs, array_of_displacements + w);
+                    MPI_Get_address(aggregate_buf + sizeof(int) * nprocs, array_of_displacements + w);
                 } else {
                     /* Inclusive prefix sum (current index - previous) index works out the value at current index.*/
                     array_of_blocklengths[w] = local_lens[w * nprocs + local_aggregators[i]] - local_lens[w * nprocs + local_aggregators[i] - 1];
-                    MPI_Address(aggregate_buf + sizeof(int) * nprocs * (w + 1) + local_lens[w * nprocs + local_aggregators[i] - 1], array_of_displacements + w);
+                    MPI_Get_address(aggregate_buf + sizeof(int) * nprocs * (w + 1) + local_lens[w * nprocs + local_aggregators[i] - 1], array_of_displacements + w);
                 }
                 temp2 += array_of_blocklengths[w];
             }
@@ -828,7 +1395,7 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
         /* Allocate data buffer: local gather data for processes on the same node + concatenating data on this process*/
         temp_buf_size = local_lens[ nprocs_aggregator * nprocs - 1 ];
         if (temp_buf_size){
-            aggregate_buf = (char*) ADIOI_Malloc(sizeof(char) * temp_buf_size);
+            aggregate_buf = comm_buf_alloc(temp_buf_size);
         }
         /* Copy send data from send buffer to a contiguous memory space (to be sent out at once.)*/
         ptr = aggregate_buf;
@@ -848,7 +1415,7 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
     if (total_send_size){
         for (i = 0; i < nprocs; i++){
             array_of_blocklengths[i] = send_size[i];
-            MPI_Address(send_buf[i], array_of_displacements + i);
+            MPI_Get_address(send_buf[i], array_of_displacements + i);
         }
         MPI_Type_create_hindexed(nprocs, array_of_blocklengths, array_of_displacements, MPI_BYTE, &new_type);
         MPI_Type_commit(&new_type);
@@ -887,11 +1454,11 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
                 // Recall that local_lens is inclusive prefix sum of send length.
                 if ( w == 0 && global_aggregators[i] == 0 ){
                     array_of_blocklengths[w] = local_lens[w * nprocs + global_aggregators[i]];
-                    MPI_Address(aggregate_buf, array_of_displacements + w);
+                    MPI_Get_address(aggregate_buf, array_of_displacements + w);
                 } else {
                     /* Inclusive prefix sum (current index - previous) index works out the value at current index.*/
                     array_of_blocklengths[w] = local_lens[w * nprocs + global_aggregators[i]] - local_lens[w * nprocs + global_aggregators[i] - 1];
-                    MPI_Address(aggregate_buf + local_lens[w * nprocs + global_aggregators[i] - 1], array_of_displacements + w);
+                    MPI_Get_address(aggregate_buf + local_lens[w * nprocs + global_aggregators[i] - 1], array_of_displacements + w);
                 }
                 temp2 += array_of_blocklengths[w];
             }
@@ -915,7 +1482,7 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
         }
         ADIOI_Free(new_types);
         if (temp_buf_size){
-            ADIOI_Free(aggregate_buf);
+            comm_buf_free(aggregate_buf);
         }
     }
     ADIOI_Free(array_of_blocklengths);
@@ -926,6 +1493,340 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
 }
 
 
+#if MPI_VERSION < 4
+static int create_large_byte_type(MPI_Aint count, MPI_Datatype *new_type){
+    MPI_Datatype chunk, types[2];
+    int blocklens[2];
+    MPI_Aint displs[2];
+    MPI_Type_contiguous(LARGE_COUNT_CHUNK, MPI_BYTE, &chunk);
+    blocklens[0] = (int) (count / LARGE_COUNT_CHUNK);
+    blocklens[1] = (int) (count % LARGE_COUNT_CHUNK);
+    displs[0] = 0;
+    displs[1] = (MPI_Aint) blocklens[0] * LARGE_COUNT_CHUNK;
+    types[0] = chunk;
+    types[1] = MPI_BYTE;
+    MPI_Type_create_struct(2, blocklens, displs, types, new_type);
+    MPI_Type_commit(new_type);
+    MPI_Type_free(&chunk);
+    return 0;
+}
+#endif
+
+/*
+  Point-to-point byte messages whose size does not fit in an int, as the node aggregates of TAM easily exceed 2 GiB. The MPI-4 large-count calls are
+  used when available. Otherwise both ends describe a large message with the same derived datatype (its type signature is still count bytes).
+*/
+int issend_bytes(char *buf, MPI_Aint count, int dest, int tag, MPI_Comm comm, MPI_Request *request){
+#if MPI_VERSION >= 4
+    return MPI_Issend_c(buf, (MPI_Count) count, MPI_BYTE, dest, tag, comm, request);
+#else
+    MPI_Datatype large_type;
+    int ret;
+    if (count <= LARGE_COUNT_LIMIT){
+        return MPI_Issend(buf, (int) count, MPI_BYTE, dest, tag, comm, request);
+    }
+    create_large_byte_type(count, &large_type);
+    ret = MPI_Issend(buf, 1, large_type, dest, tag, comm, request);
+    MPI_Type_free(&large_type);
+    return ret;
+#endif
+}
+
+int irecv_bytes(char *buf, MPI_Aint count, int source, int tag, MPI_Comm comm, MPI_Request *request){
+#if MPI_VERSION >= 4
+    return MPI_Irecv_c(buf, (MPI_Count) count, MPI_BYTE, source, tag, comm, request);
+#else
+    MPI_Datatype large_type;
+    int ret;
+    if (count <= LARGE_COUNT_LIMIT){
+        return MPI_Irecv(buf, (int) count, MPI_BYTE, source, tag, comm, request);
+    }
+    create_large_byte_type(count, &large_type);
+    ret = MPI_Irecv(buf, 1, large_type, source, tag, comm, request);
+    MPI_Type_free(&large_type);
+    return ret;
+#endif
+}
+
+/*
+  Sparse message sizes of the processes of a node, gathered at their proxy. The (peer, bytes) entries of local process i are [first[i], first[i + 1]),
+  sorted by peer. pos is the exclusive prefix sum of the sizes over all entries, pos[first[nprocs_node]] is the total.
+*/
+typedef struct{
+    int *first;
+    int *peer;
+    int *len;
+    MPI_Aint *pos;
+}Tam_sizes;
+
+/* A message of local process local to process peer on node node, stored at pos of the aggregate buffer of the proxy.*/
+typedef struct{
+    int node;
+    int peer;
+    int local;
+    int len;
+    MPI_Aint pos;
+}Tam_message;
+
+/* Order of the messages in the buffer sent to a node: by node, then by destination rank, then by local source.*/
+static int tam_compare_message(const void *a, const void *b){
+    const Tam_message *x = (const Tam_message*) a, *y = (const Tam_message*) b;
+    if ( x->node != y->node ){
+        return x->node < y->node ? -1 : 1;
+    }
+    if ( x->peer != y->peer ){
+        return x->peer < y->peer ? -1 : 1;
+    }
+    return ( x->local > y->local ) - ( x->local < y->local );
+}
+
+/*
+  Sparse size list of this process for its proxy: the number of non-zero sends ns and receives nr, then ns (peer, bytes) pairs of sends and nr pairs of
+  receives, both sorted by peer. count is set to the length of the returned array.
+*/
+static int *tam_pack_sizes(int nprocs, int *send_size, int *recv_size, int *count){
+    int *list, ns = 0, nr = 0, i, k;
+    for ( i = 0; i < nprocs; i++ ){
+        ns += send_size[i] > 0;
+        nr += recv_size[i] > 0;
+    }
+    count[0] = 2 + 2 * (ns + nr);
+    list = (int*) ADIOI_Malloc(sizeof(int) * count[0]);
+    list[0] = ns;
+    list[1] = nr;
+    k = 2;
+    for ( i = 0; i < nprocs; i++ ){
+        if (send_size[i]){
+            list[k++] = i;
+            list[k++] = send_size[i];
+        }
+    }
+    for ( i = 0; i < nprocs; i++ ){
+        if (recv_size[i]){
+            list[k++] = i;
+            list[k++] = recv_size[i];
+        }
+    }
+    return list;
+}
+
+/* Collect the sends (recv = 0) or the receives (recv = 1) of the size lists of the nprocs_node local processes.*/
+static int tam_build_sizes(int nprocs_node, int **lists, int recv, Tam_sizes *sizes){
+    int i, k, n = 0, total = 0, *pairs;
+    for ( i = 0; i < nprocs_node; i++ ){
+        total += lists[i][recv];
+    }
+    sizes->first = (int*) ADIOI_Malloc(sizeof(int) * (nprocs_node + 1 + 2 * total));
+    sizes->peer = sizes->first + nprocs_node + 1;
+    sizes->len = sizes->peer + total;
+    sizes->pos = (MPI_Aint*) ADIOI_Malloc(sizeof(MPI_Aint) * (total + 1));
+    sizes->pos[0] = 0;
+    for ( i = 0; i < nprocs_node; i++ ){
+        sizes->first[i] = n;
+        pairs = lists[i] + 2 + ( recv ? 2 * lists[i][0] : 0 );
+        for ( k = 0; k < lists[i][recv]; k++ ){
+            sizes->peer[n] = pairs[2 * k];
+            sizes->len[n] = pairs[2 * k + 1];
+            sizes->pos[n + 1] = sizes->pos[n] + sizes->len[n];
+            n++;
+        }
+    }
+    sizes->first[nprocs_node] = n;
+    return 0;
+}
+
+static int tam_free_sizes(Tam_sizes *sizes){
+    ADIOI_Free(sizes->first);
+    ADIOI_Free(sizes->pos);
+    return 0;
+}
+
+/* Total bytes of local process i.*/
+static MPI_Aint tam_rank_size(Tam_sizes *sizes, int i){
+    return sizes->pos[sizes->first[i + 1]] - sizes->pos[sizes->first[i]];
+}
+
+/* Segment of local process i (i > 0) in the delivery buffer of the proxy, NULL for the proxy itself.*/
+static char *tam_rank_buf(Tam_sizes *r_sizes, int i, char *aggregate_buf){
+    if ( i == 0 ){
+        return NULL;
+    }
+    return aggregate_buf + r_sizes->pos[r_sizes->first[i]] - r_sizes->pos[r_sizes->first[1]];
+}
+
+/* Pack the messages [first, last) of the sorted message list, all to the processes of one node, into dst.*/
+static int tam_pack_node(Tam_message *messages, int first, int last, char *aggregate_buf, char *dst){
+    int k;
+    for ( k = first; k < last; k++ ){
+        memcpy(dst, aggregate_buf + messages[k].pos, messages[k].len);
+        dst += messages[k].len;
+    }
+    return 0;
+}
+
+/*
+  Unpack the messages for local process i (local_ranks[i]) out of the buffers received from the node proxies. offsets holds the position of this process
+  in the buffer of every node and is advanced while copying. The proxy (i = 0) copies straight into recv_buf, the others into their segment dst.
+*/
+static int tam_unpack_rank(int i, int *process_node_list, Tam_sizes *r_sizes, char **offsets, char **recv_buf, char *dst){
+    int k, w;
+    for ( k = r_sizes->first[i]; k < r_sizes->first[i + 1]; k++ ){
+        w = r_sizes->peer[k];
+        if ( i == 0 ){
+            memcpy(recv_buf[w], offsets[process_node_list[w]], r_sizes->len[k]);
+        } else {
+            memcpy(dst, offsets[process_node_list[w]], r_sizes->len[k]);
+            dst += r_sizes->len[k];
+        }
+        offsets[process_node_list[w]] += r_sizes->len[k];
+    }
+    return 0;
+}
+
+/*
+  Unpack the part of the buffer received from node n (starting at src) that belongs to local process i. The proxy (i = 0) copies straight into recv_buf,
+  the others into their segment dst, at the position given by the prefix sums of r_sizes.
+*/
+static int tam_unpack_node(int i, int n, int *process_node_list, Tam_sizes *r_sizes, char *src, char **recv_buf, char *dst){
+    int k, w;
+    for ( k = r_sizes->first[i]; k < r_sizes->first[i + 1]; k++ ){
+        w = r_sizes->peer[k];
+        if ( process_node_list[w] != n ){
+            continue;
+        }
+        if ( i == 0 ){
+            memcpy(recv_buf[w], src, r_sizes->len[k]);
+        } else {
+            memcpy(dst + r_sizes->pos[k] - r_sizes->pos[r_sizes->first[i]], src, r_sizes->len[k]);
+        }
+        src += r_sizes->len[k];
+    }
+    return 0;
+}
+
+/*
+  Completion-driven delivery: node n's buffer (src) has arrived. Unpack its part for every local process that expects data from it, and start the delivery
+  Issend of every local process whose inputs are now all in (pending counts the nodes still missing for each local process).
+*/
+static int tam_deliver_node(int n, int nprocs_node, int nrecvs, int *local_ranks, int *process_node_list, Tam_sizes *r_sizes, MPI_Aint *rank_node_lens, char **r_offsets, int *pending, char **recv_buf, char *aggregate_buf, int iter, MPI_Comm comm, MPI_Request *intra_req, int *ndeliver, Timer *timer){
+    double start;
+    int i;
+    start = MPI_Wtime();
+    #pragma omp parallel for num_threads(tam_copy_threads) schedule(dynamic) if (tam_copy_threads > 1)
+    for ( i = 0; i < nprocs_node; i++ ){
+        if (rank_node_lens[i * nrecvs + n]){
+            tam_unpack_node(i, n, process_node_list, r_sizes, r_offsets[i * nrecvs + n], recv_buf, tam_rank_buf(r_sizes, i, aggregate_buf));
+        }
+    }
+    timer->copy_time += MPI_Wtime() - start;
+    for ( i = 0; i < nprocs_node; i++ ){
+        if (!rank_node_lens[i * nrecvs + n]){
+            continue;
+        }
+        pending[i]--;
+        if ( i == 0 || pending[i] ){
+            continue;
+        }
+        issend_bytes(tam_rank_buf(r_sizes, i, aggregate_buf), tam_rank_size(r_sizes, i), local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[ndeliver[0]++]);
+    }
+    return 0;
+}
+
+/* Node-local and proxy communicators of collective_write, cached on the communicator of the caller.*/
+typedef struct{
+    MPI_Comm node_comm;
+    MPI_Comm proxy_comm;
+}Tam_comms;
+
+static int tam_comms_keyval = MPI_KEYVAL_INVALID;
+
+static int tam_comms_delete(MPI_Comm comm, int keyval, void *attribute_val, void *extra_state){
+    Tam_comms *comms = (Tam_comms*) attribute_val;
+    (void) comm;
+    (void) keyval;
+    (void) extra_state;
+    MPI_Comm_free(&comms->node_comm);
+    if (comms->proxy_comm != MPI_COMM_NULL){
+        MPI_Comm_free(&comms->proxy_comm);
+    }
+    ADIOI_Free(comms);
+    return MPI_SUCCESS;
+}
+
+/*
+  The node-local communicator (ranked as local_ranks, the proxy is rank 0) and the proxy communicator (ranked by node index, MPI_COMM_NULL on the other
+  processes) of comm. They are created collectively on the first call and cached on comm as an attribute, so the node assignment must not change
+  between calls on the same communicator (use a duplicate of comm for another assignment).
+*/
+static Tam_comms *tam_get_comms(int myrank, int *local_ranks, int *process_node_list, MPI_Comm comm){
+    Tam_comms *comms;
+    int flag;
+    if (tam_comms_keyval == MPI_KEYVAL_INVALID){
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, tam_comms_delete, &tam_comms_keyval, NULL);
+    }
+    MPI_Comm_get_attr(comm, tam_comms_keyval, &comms, &flag);
+    if (flag){
+        return comms;
+    }
+    comms = (Tam_comms*) ADIOI_Malloc(sizeof(Tam_comms));
+    MPI_Comm_split(comm, process_node_list[myrank], myrank, &comms->node_comm);
+    MPI_Comm_split(comm, myrank == local_ranks[0] ? 0 : MPI_UNDEFINED, process_node_list[myrank], &comms->proxy_comm);
+    MPI_Comm_set_attr(comm, tam_comms_keyval, comms);
+    return comms;
+}
+
+/*
+  Creates the communicators collective_write uses with tam_meta_collective ahead of a timed section, so its first call is not charged for the
+  splits. Nothing to do without tam_meta_collective. Collective over comm.
+*/
+int collective_write_prepare(int myrank, int *local_ranks, int *process_node_list, MPI_Comm comm){
+    if (tam_meta_collective){
+        tam_get_comms(myrank, local_ranks, process_node_list, comm);
+    }
+    return 0;
+}
+
+/*
+  Tag of the size messages of the proxies. The tags of collective_write stay far below MPI_TAG_UB, so the size messages can be received with
+  MPI_ANY_SOURCE. Consecutive calls alternate between two tags: a proxy may start the next call while another one is still polling in this one.
+*/
+static int tam_nbx_tag(MPI_Comm comm){
+    static int round = 0;
+    int *tag_ub, flag;
+    MPI_Comm_get_attr(comm, MPI_TAG_UB, &tag_ub, &flag);
+    round++;
+    return ( flag ? tag_ub[0] : 32767 ) - ( round & 1 );
+}
+
+/*
+  Nonblocking consensus (NBX) for the sizes of the messages between node proxies. Every proxy has sent its non-zero sizes with the nsends Issends in
+  req. Sizes are received from whichever proxy sends one (MPI_Iprobe). Once all Issends of this proxy are matched it enters a nonblocking barrier,
+  and when the barrier completes every size has been received. Node pairs without data cost nothing. Collective over comm: the processes that are
+  not proxies only enter the barrier.
+*/
+static int tam_nbx_sizes(int nsends, MPI_Request *req, int tag, int *process_node_list, MPI_Aint *global_r_lens, MPI_Comm comm){
+    MPI_Request barrier_req = MPI_REQUEST_NULL;
+    MPI_Status status;
+    MPI_Aint size;
+    int flag, done = 0;
+    while (!done){
+        MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+        if (flag){
+            MPI_Recv(&size, 1, MPI_AINT, status.MPI_SOURCE, tag, comm, MPI_STATUS_IGNORE);
+            global_r_lens[process_node_list[status.MPI_SOURCE]] = size;
+        }
+        if (barrier_req == MPI_REQUEST_NULL){
+            MPI_Testall(nsends, req, &flag, MPI_STATUSES_IGNORE);
+            if (flag){
+                MPI_Ibarrier(comm, &barrier_req);
+            }
+        } else {
+            MPI_Test(&barrier_req, &done, MPI_STATUS_IGNORE);
+        }
+    }
+    return 0;
+}
+
 /*
   Input:
        1. myrank: process rank
@@ -942,12 +1843,20 @@ int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_
        1. recv_buf : An array of receive buffer pointers (of size nprocs) for this process. It must have the correct messages in the end.
 */
 int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* local_ranks, int* global_receivers, int *process_node_list, int *recv_size, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm, Timer *timer){
-    char *aggregate_buf = NULL, *local_buf = NULL, *tmp_buf = NULL, *ptr, *ptr2, *s_buf2 = NULL, **r_buf = NULL, **ptrs = NULL;
-    int i, j, w, v, temp=0, temp2=0;
+    char *aggregate_buf = NULL, *local_buf = NULL, *tmp_buf = NULL, *ptr, *ptr2, *s_buf2 = NULL, **r_buf = NULL, **ptrs = NULL, **r_offsets;
+    int i, j, k, w, v, flag;
+    MPI_Aint temp=0;
+    MPI_Message intra_message;
     MPI_Request *intra_req, *req = NULL;
     MPI_Status *intra_sts, *sts = NULL;
     double start;
-    int *global_s_lens = NULL, *global_r_lens = NULL, *local_lens = NULL, node_message_size=0, r_rank, node_recv_size=0, *s_lens = NULL, *r_lens = NULL, total_recv_size, total_send_size, aggregate_buffer_size = 0;
+    int *local_lens = NULL, **size_lists = NULL, *list_counts = NULL, *list_displs = NULL, count, r_rank, nbx_tag;
+    int *req_node = NULL, *indices = NULL, *pending = NULL, *node_first = NULL, outcount, ndone, ndeliver = 0;
+    Tam_sizes s_sizes, r_sizes;
+    Tam_message *messages = NULL;
+    Tam_comms *comms = NULL;
+    /* Sizes summed over several messages may exceed 2 GiB, only the size of a single pair is an int.*/
+    MPI_Aint *global_s_lens = NULL, *global_r_lens = NULL, node_message_size=0, node_recv_size=0, total_recv_size, total_send_size, aggregate_buffer_size = 0, *rank_node_lens;
     /* Count total message size to be sent/recv from this process. (To be optimized)*/
     total_send_size = 0;
     total_recv_size = 0;
@@ -956,7 +1865,7 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         total_recv_size += recv_size[i];
     }
     /*
-      temp, temp2 : general purpose temporary integer variable
+      temp : general purpose temporary integer variable
       total_recv_size: total message size to be received for this process.
       node_message_size: for proxy process only. Total message size to be sent out from this node.
       node_recv_size: for proxy process only. Total message size to be received from global nodes.
@@ -973,76 +1882,108 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         /* Requeust and status used for inter-node communication*/
         req = intra_req + nprocs_node;
         sts = intra_sts + nprocs_node;
-        /* Intra-node send/receive size (every process locally * every process globally)*/
-        s_lens = (int*) ADIOI_Malloc(2*sizeof(int)*nprocs*nprocs_node);
-        r_lens = s_lens + nprocs * nprocs_node;
         /* Inter-node send size (to all nodes)*/
-        global_s_lens = (int*) ADIOI_Malloc(2*sizeof(int)*nrecvs);
+        global_s_lens = (MPI_Aint*) ADIOI_Malloc(2*sizeof(MPI_Aint)*nrecvs);
         /* Inter-node recv size (from all nodes)*/
         global_r_lens = global_s_lens + nrecvs;
         /* A buffer for r_buf (each row of r_buf stores all messages received from inter-node process)*/
         ptrs = (char**) ADIOI_Malloc(sizeof(char*)*nrecvs);
         /* r_buf is a two dimensional array. Every row contains buffer to be received from proxy processes at a node. */
         r_buf = (char **) ADIOI_Malloc(nrecvs*sizeof(char*));
-        // Buffer for receiving send/recv size from processes on local node.
-        local_lens = (int*) ADIOI_Malloc(sizeof(int)*nprocs*nprocs_node*2);
+        // Sparse size lists of the processes on local node.
+        size_lists = (int**) ADIOI_Malloc(sizeof(int*)*nprocs_node);
     }else{
-        /* Non-proxy process can only receive or send one at a time*/
-        intra_req = (MPI_Request *) ADIOI_Malloc(sizeof(MPI_Request));
-        intra_sts = (MPI_Status *) ADIOI_Malloc(sizeof(MPI_Status));
-        // Buffer for sending send and receive size at the same node
-        local_lens = (int*) ADIOI_Malloc(sizeof(int)*nprocs*2);
+        /* Non-proxy process can only receive or send one at a time, besides its part of the barrier of the proxy size exchange*/
+        intra_req = (MPI_Request *) ADIOI_Malloc(2 * sizeof(MPI_Request));
+        intra_sts = (MPI_Status *) ADIOI_Malloc(2 * sizeof(MPI_Status));
     }
-    /* Intra-node gather for send size to a proxy process.*/
+    /*
+      Intra-node gather of the send and receive sizes to the proxy process. Every process sends only its non-zero sizes as (peer, bytes) pairs, so the
+      metadata grows with the number of peers rather than with nprocs. The length of a list is only known at arrival (MPI_Improbe).
+    */
     j = 0;
-    /* Send local send size to proxy process*/
-    /* Condition for the proxy process, (note it may not be an aggregator)*/
-
-    if (myrank==local_ranks[0]){
-        /* Proxy process receive from local processes for their send size*/
-        memcpy(s_lens, send_size, sizeof(int) * nprocs);
-        memcpy(r_lens, recv_size, sizeof(int) * nprocs);
+    if (tam_meta_collective){
+        /* The same gather as a collective on the node communicator, the lists are gathered into one buffer.*/
+        comms = tam_get_comms(myrank, local_ranks, process_node_list, comm);
+        local_lens = tam_pack_sizes(nprocs, send_size, recv_size, &count);
+        start = MPI_Wtime();
+        if (myrank==local_ranks[0]){
+            list_counts = (int*) ADIOI_Malloc(sizeof(int)*2*nprocs_node);
+            list_displs = list_counts + nprocs_node;
+        }
+        MPI_Gather(&count, 1, MPI_INT, list_counts, 1, MPI_INT, 0, comms->node_comm);
+        if (myrank==local_ranks[0]){
+            list_displs[0] = 0;
+            for (i=1; i<nprocs_node; i++){
+                list_displs[i] = list_displs[i-1] + list_counts[i-1];
+            }
+            size_lists[0] = (int*) ADIOI_Malloc(sizeof(int)*(list_displs[nprocs_node-1] + list_counts[nprocs_node-1]));
+            for (i=1; i<nprocs_node; i++){
+                size_lists[i] = size_lists[0] + list_displs[i];
+            }
+        }
+        MPI_Gatherv(local_lens, count, MPI_INT, size_lists ? size_lists[0] : NULL, list_counts, list_displs, MPI_INT, 0, comms->node_comm);
+        timer->recv_wait_all_time += MPI_Wtime() - start;
+    } else if (myrank==local_ranks[0]){
+        /* Condition for the proxy process, (note it may not be an aggregator)*/
+        size_lists[0] = tam_pack_sizes(nprocs, send_size, recv_size, &count);
+        start = MPI_Wtime();
         for (i=1; i<nprocs_node; i++){
-            MPI_Irecv(local_lens + i * nprocs * 2, 2 * nprocs, MPI_INT, local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
-
+            size_lists[i] = NULL;
         }
+        /* Lists are taken in arrival order (every list has at least 2 entries, so NULL marks one still missing), a late process does not hold up the others.*/
+        for (ndone=1; ndone<nprocs_node; ){
+            for (i=1; i<nprocs_node; i++){
+                if (size_lists[i] != NULL){
+                    continue;
+                }
+                MPI_Improbe(local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &flag, &intra_message, &intra_sts[0]);
+                if (flag){
+                    MPI_Get_count(&intra_sts[0], MPI_INT, &count);
+                    size_lists[i] = (int*) ADIOI_Malloc(sizeof(int)*count);
+                    MPI_Mrecv(size_lists[i], count, MPI_INT, &intra_message, &intra_sts[0]);
+                    ndone++;
+                }
+            }
+        }
+        timer->recv_wait_all_time += MPI_Wtime() - start;
     } else{
-        memcpy(local_lens,send_size,sizeof(int)*nprocs);
-        memcpy(local_lens+nprocs,recv_size,sizeof(int)*nprocs);
-        MPI_Isend(local_lens, 2 * nprocs, MPI_INT, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
+        local_lens = tam_pack_sizes(nprocs, send_size, recv_size, &count);
+        MPI_Isend(local_lens, count, MPI_INT, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
     }
     if (j) {
         start = MPI_Wtime();
         MPI_Waitall(j, intra_req, intra_sts);
         timer->recv_wait_all_time += MPI_Wtime() - start;
     }
+    if (local_lens != NULL){
+        ADIOI_Free(local_lens);
+    }
     #if DEBUG==1
     MPI_Barrier(comm);
     if (myrank==0){
         printf("rank %d starting intra-node gather recv size\n",myrank);
     }
     #endif
-    /* Local processes send their receive size to the proxy process (for later use after inter-node communication.)*/
     j = 0;
     if (myrank==local_ranks[0]){
-        for ( i = 1; i < nprocs_node; i++ ){
-            memcpy(s_lens + i * nprocs, local_lens + nprocs * 2 * i, sizeof(int) * nprocs);
-            memcpy(r_lens + i * nprocs, local_lens + nprocs * ( 2 * i + 1 ), sizeof(int) * nprocs);
-        }
-        /* s_lens and r_lens are converted to prefix-sum representation (exclusive) (for the purpose of optimization used later)*/
-        for ( i = 0; i < nprocs*nprocs_node; i++ ){
-            temp2 = s_lens[i];
-            s_lens[i] = node_message_size;
-            node_message_size += temp2;
-
-            temp = r_lens[i];
-            r_lens[i] = node_recv_size;
-            node_recv_size += temp;
+        /* s_sizes and r_sizes hold the sizes in prefix-sum representation (exclusive) (for the purpose of optimization used later)*/
+        tam_build_sizes(nprocs_node, size_lists, 0, &s_sizes);
+        tam_build_sizes(nprocs_node, size_lists, 1, &r_sizes);
+        node_message_size = s_sizes.pos[s_sizes.first[nprocs_node]];
+        node_recv_size = r_sizes.pos[r_sizes.first[nprocs_node]];
+        /* size_lists will not be used anymore*/
+        if (tam_meta_collective){
+            ADIOI_Free(size_lists[0]);
+            ADIOI_Free(list_counts);
+        } else{
+            for (i=0; i<nprocs_node; i++){
+                ADIOI_Free(size_lists[i]);
+            }
         }
-        /* local_lens will not be used anymore*/
-        ADIOI_Free(local_lens);
+        ADIOI_Free(size_lists);
         /* End of intra-node gather for send/recv size.
-           s_lens stores size nprocs_node * nprocs number of integers that indicate which local process sends to which aggregator (at local proxy process).
+           s_sizes stores which local process sends to which aggregator (at local proxy process).
         */
         /* We copy all the data into a contiguous buffer and send at once.*/
         /* We aggregate all messages to be sent to a local proxy that does everything for this node at once.*/
@@ -1054,7 +1995,7 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         temp = aggregate_buffer_size;
         if (aggregate_buffer_size){
             /* s_buf2 is the buffer used for reordering aggregate_buf*/
-            s_buf2 = (char*) ADIOI_Malloc(sizeof(char)*node_message_size);
+            s_buf2 = comm_buf_alloc(node_message_size);
         }
     }
     if (total_send_size < total_recv_size){
@@ -1063,7 +2004,7 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         aggregate_buffer_size += total_send_size;
     }
     if (aggregate_buffer_size){
-        aggregate_buf = (char*) ADIOI_Malloc(sizeof(char)*aggregate_buffer_size);
+        aggregate_buf = comm_buf_alloc(aggregate_buffer_size);
         local_buf = aggregate_buf + temp;
     }
     if (total_send_size){
@@ -1085,19 +2026,15 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         }
         ptr = aggregate_buf + total_send_size;
         for (i=1; i<nprocs_node; i++){
-            if ( i == nprocs_node - 1 ){
-                temp = node_message_size - s_lens[i*nprocs];
-            } else{
-                temp = s_lens[(i+1)*nprocs] - s_lens[i*nprocs];
-            }
+            temp = tam_rank_size(&s_sizes, i);
             if (temp) {
-                MPI_Irecv(ptr, temp, MPI_BYTE, local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
+                irecv_bytes(ptr, temp, local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
             }
             ptr += temp;
         }
     }else{
         if (total_send_size){
-            MPI_Issend(local_buf, total_send_size, MPI_BYTE, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
+            issend_bytes(local_buf, total_send_size, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
         }
     }
     if (j) {
@@ -1112,61 +2049,94 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         printf("rank %d starting inter-node gather\n",myrank);
     }
     #endif
+    /*
+      Every process advances the tag round, also the ones that are not proxies in this call: the proxies change with the communication pattern, and a
+      proxy that skipped a call would use the other tag than its peers.
+    */
+    nbx_tag = tam_nbx_tag(comm);
     /*Proxy processses at different nodes exchange messages (all-to-all) */
     if (myrank==local_ranks[0]){
         j=0;
-        /* Keep track of the intergroup send buffer*/
-        ptr = s_buf2;
-        /* Figure out the message and size to be sent to individual aggregator*/
+        /*
+          Sizes of the aggregated messages to every node first, so the segment of every node in s_buf2 is known before packing. The messages are sorted
+          by destination node, rank and local source, node_first[i] is the first message to node i.
+        */
+        messages = (Tam_message*) ADIOI_Malloc(sizeof(Tam_message)*(s_sizes.first[nprocs_node] + 1));
+        node_first = (int*) ADIOI_Malloc(sizeof(int)*(nrecvs + 1));
+        for (w=0; w<nprocs_node; w++){
+            for (k=s_sizes.first[w]; k<s_sizes.first[w+1]; k++){
+                messages[k].node = process_node_list[s_sizes.peer[k]];
+                messages[k].peer = s_sizes.peer[k];
+                messages[k].local = w;
+                messages[k].len = s_sizes.len[k];
+                messages[k].pos = s_sizes.pos[k];
+            }
+        }
+        qsort(messages, s_sizes.first[nprocs_node], sizeof(Tam_message), tam_compare_message);
         for (i=0; i<nrecvs; i++){
-            temp2 = 0;
-            // Iterate through all processes
-            // These loops would prepare for all messages (arranged contiguously) to be sent to process v in order of local process ranks.
-            for ( v = 0; v < nprocs; v++ ){
-                // Check if this process belongs to the ith node.
-                if ( process_node_list[v] == i){
-                    for ( w = 0; w < nprocs_node; w++ ) {
-                        // Recall that s_lens is exclusive prefix sum of send length.
-                        // s_lens[w*nprocs + v] means the message size of the wth process send to process v (note it is in exclusive prefix-sum representation, so we can jump the data pointer to the location without extra computation).
-                        temp = w*nprocs+v;
-                        if ( temp < nprocs * nprocs_node -1 ){
-                            if (s_lens[temp+1]-s_lens[temp]){
-                                memcpy(ptr+temp2, aggregate_buf+s_lens[temp], s_lens[temp+1]-s_lens[temp]);
-                                temp2 += (s_lens[temp+1]-s_lens[temp]);
-                            }
-                        } else {
-                            if (node_message_size - s_lens[temp]){
-                                memcpy(ptr+temp2, aggregate_buf+s_lens[temp], node_message_size - s_lens[temp]);
-                                temp2 += (node_message_size - s_lens[temp]);
-                            }
-                        }
-                    }
-                }
+            global_s_lens[i] = 0;
+        }
+        k = 0;
+        for (i=0; i<nrecvs; i++){
+            node_first[i] = k;
+            for (; k<s_sizes.first[nprocs_node] && messages[k].node == i; k++){
+                global_s_lens[i] += messages[k].len;
             }
-            ptr += temp2;
-            /* Exchange receive size among receivers*/
+        }
+        node_first[nrecvs] = k;
+        /* Exchange receive size among receivers (NBX), only the proxies of nodes that actually exchange data contact each other.*/
+        if (tam_meta_collective){
+            /* With collectives, all sizes at once on the proxy communicator (ranked by node).*/
+            MPI_Ialltoall(global_s_lens, 1, MPI_AINT, global_r_lens, 1, MPI_AINT, comms->proxy_comm, &req[j++]);
+        }
+        for (i=0; i<nrecvs && !tam_meta_collective; i++){
             r_rank = global_receivers[i];
-            // global_s_lens[i] is the total message size to be sent from this node to the ith node.
-            global_s_lens[i] = temp2;
+            global_r_lens[i] = 0;
             //Let the ith node proxy know the message size to be sent from this node.
             if (r_rank != myrank){
-                //Figure out the message to be received from the ith node proxy.
-                MPI_Irecv(global_r_lens+i, 1, MPI_INT, r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
-                MPI_Issend(global_s_lens+i, 1, MPI_INT, r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
+                if (global_s_lens[i]){
+                    MPI_Issend(global_s_lens+i, 1, MPI_AINT, r_rank, nbx_tag, comm, &req[j++]);
+                }
             }else{
-                global_r_lens[i] = temp2;
+                global_r_lens[i] = global_s_lens[i];
             }
         }
-        /* End of intergroup message size exchange. global_s_lens is an array of size nrecvs (number of nodes) that stores the aggregated message size to be sent to different node from this node. global_r_lens is an array of size nrecvs that stores the message size to be received from all nodes.*/
-        if (j){
-            start = MPI_Wtime();
+        /* Pack the messages to every node (contiguous, in order of destination rank, then local source) while the sizes are in flight.*/
+        start = MPI_Wtime();
+        ptr2 = s_buf2;
+        for (i=0; i<nrecvs; i++){
+            ptrs[i] = ptr2;
+            ptr2 += global_s_lens[i];
+        }
+        #pragma omp parallel for num_threads(tam_copy_threads) schedule(dynamic) if (tam_copy_threads > 1)
+        for (i=0; i<nrecvs; i++){
+            tam_pack_node(messages, node_first[i], node_first[i+1], aggregate_buf, ptrs[i]);
+        }
+        timer->copy_time += MPI_Wtime() - start;
+        timer->copy_bytes += ptr2 - s_buf2;
+        ADIOI_Free(messages);
+        ADIOI_Free(node_first);
+        start = MPI_Wtime();
+        if (tam_meta_collective){
             MPI_Waitall(j, req, sts);
-            timer->send_wait_all_time += MPI_Wtime() - start;
+        } else{
+            tam_nbx_sizes(j, req, nbx_tag, process_node_list, global_r_lens, comm);
         }
+        timer->send_wait_all_time += MPI_Wtime() - start;
+        /* End of intergroup message size exchange. global_s_lens is an array of size nrecvs (number of nodes) that stores the aggregated message size to be sent to different node from this node. global_r_lens is an array of size nrecvs that stores the message size to be received from all nodes.*/
         j=0;
+        if (tam_waitsome){
+            /* req_node[k] is the node whose buffer request k receives, -1 for sends.*/
+            req_node = (int*) ADIOI_Malloc(sizeof(int)*(4*nrecvs + nprocs_node));
+            indices = req_node + 2 * nrecvs;
+            pending = indices + 2 * nrecvs;
+            for (i=0; i<2*nrecvs; i++){
+                req_node[i] = -1;
+            }
+        }
         // Exchange aggregated messages among receivers
         ptr2=s_buf2;
-        r_buf[0] = (char *) ADIOI_Malloc(node_recv_size*sizeof(char));
+        r_buf[0] = comm_buf_alloc(node_recv_size);
         for (i=0; i<nrecvs; i++){
             r_rank = global_receivers[i];
             if ( i > 0 ){
@@ -1174,10 +2144,13 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
             }
             if (myrank != r_rank){
                 if (global_s_lens[i]){
-                    MPI_Issend(ptr2, global_s_lens[i], MPI_BYTE, r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
+                    issend_bytes(ptr2, global_s_lens[i], r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
                 }
                 if (global_r_lens[i]){
-                    MPI_Irecv(r_buf[i], global_r_lens[i], MPI_BYTE, r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
+                    irecv_bytes(r_buf[i], global_r_lens[i], r_rank, r_rank + myrank + 100 * iter, comm, &req[j++]);
+                    if (tam_waitsome){
+                        req_node[j-1] = i;
+                    }
                 }
             }else{
                 if (global_r_lens[i]){
@@ -1188,8 +2161,44 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
             //store the beginning of buffer received from every receiver.
             ptrs[i] = r_buf[i];
         }
-        // wait for all irecv/isend to complete
-        if (j){
+        if (tam_waitsome){
+            /* rank_node_lens[i * nrecvs + n] is the size of the part of the buffer of node n for local process i, starting at r_offsets[i * nrecvs + n].*/
+            r_offsets = (char**) ADIOI_Malloc(sizeof(char*)*nprocs_node*nrecvs);
+            rank_node_lens = (MPI_Aint*) ADIOI_Malloc(sizeof(MPI_Aint)*nprocs_node*nrecvs);
+            for (i=0; i<nprocs_node; i++){
+                memcpy(r_offsets + i * nrecvs, ptrs, sizeof(char*) * nrecvs);
+                memset(rank_node_lens + i * nrecvs, 0, sizeof(MPI_Aint) * nrecvs);
+                pending[i] = 0;
+                for (k=r_sizes.first[i]; k<r_sizes.first[i+1]; k++){
+                    v = process_node_list[r_sizes.peer[k]];
+                    pending[i] += !rank_node_lens[i * nrecvs + v];
+                    rank_node_lens[i * nrecvs + v] += r_sizes.len[k];
+                    ptrs[v] += r_sizes.len[k];
+                }
+                timer->copy_bytes += tam_rank_size(&r_sizes, i);
+            }
+            /* The buffer of this node is already in place.*/
+            tam_deliver_node(process_node_list[myrank], nprocs_node, nrecvs, local_ranks, process_node_list, &r_sizes, rank_node_lens, r_offsets, pending, recv_buf, aggregate_buf, iter, comm, intra_req, &ndeliver, timer);
+            ndone = 0;
+            while (ndone < j){
+                start = MPI_Wtime();
+                MPI_Waitsome(j, req, &outcount, indices, sts);
+                timer->send_wait_all_time += MPI_Wtime() - start;
+                if (outcount == MPI_UNDEFINED){
+                    break;
+                }
+                ndone += outcount;
+                for (v=0; v<outcount; v++){
+                    if (req_node[indices[v]] >= 0){
+                        tam_deliver_node(req_node[indices[v]], nprocs_node, nrecvs, local_ranks, process_node_list, &r_sizes, rank_node_lens, r_offsets, pending, recv_buf, aggregate_buf, iter, comm, intra_req, &ndeliver, timer);
+                    }
+                }
+            }
+            ADIOI_Free(rank_node_lens);
+            ADIOI_Free(r_offsets);
+            ADIOI_Free(req_node);
+        } else if (j){
+            // wait for all irecv/isend to complete
             start = MPI_Wtime();
             MPI_Waitall(j, req, sts);
             timer->send_wait_all_time += MPI_Wtime() - start;
@@ -1210,54 +2219,56 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
         printf("starting local message delivery\n");
     }
     #endif
-    j=0;
-    if (myrank==local_ranks[0]){
+    /* In completion-driven mode the proxy has already unpacked everything and started ndeliver delivery Issends.*/
+    j = ndeliver;
+    if (myrank==local_ranks[0] && !tam_waitsome){
         // We must create a buffer that can be used to reorder messages. Messages received from individual node proxy process is ordered. However, the ranks are not necessarily ordered (depending on configuration). We have to pack the messages again to align with the request of individual local process.
-        // Pack messages to be sent to a local process.
-        if (total_recv_size){
-            //ptr = local_buf;
-            for (w=0; w<nprocs; w++){
-                memcpy(recv_buf[w],ptrs[process_node_list[w]],sizeof(char)*recv_size[w]);
-                //memcpy(ptr,ptrs[process_node_list[w]],sizeof(char)*recv_size[w]);
-                // ptrs[process_node_list[w]] is in order, we can shift the pointer to the next location and access its content.
-                ptrs[process_node_list[w]] += recv_size[w];
-                //ptr += recv_size[w];
+        /*
+          ptrs[n] points to the buffer received from the proxy of node n. Its messages are ordered by local rank, then by the source ranks (at the remote node).
+          r_offsets[i * nrecvs + n] is where the messages of local process i start in the buffer of node n, so every local process can be unpacked independently.
+          r_sizes holds the (source, bytes) receive entries of every local process.
+        */
+        r_offsets = (char**) ADIOI_Malloc(sizeof(char*)*nprocs_node*nrecvs);
+        for (i=0; i<nprocs_node; i++){
+            memcpy(r_offsets + i * nrecvs, ptrs, sizeof(char*) * nrecvs);
+            for (k=r_sizes.first[i]; k<r_sizes.first[i+1]; k++){
+                ptrs[process_node_list[r_sizes.peer[k]]] += r_sizes.len[k];
             }
-            //memcpy(local_buf,aggregate_buf,sizeof(char)*total_recv_size);
+            timer->copy_bytes += tam_rank_size(&r_sizes, i);
         }
-        ptr = aggregate_buf;
-        for (i=1; i<nprocs_node; i++){
-            // Figure out the total recv size of a local process.
-            if ( i == nprocs_node -1 ){
-                temp = node_recv_size - r_lens[i*nprocs];
-            } else{
-                temp = r_lens[(i+1)*nprocs] - r_lens[i*nprocs];
+        if (tam_copy_threads > 1){
+            start = MPI_Wtime();
+            #pragma omp parallel for num_threads(tam_copy_threads) schedule(dynamic)
+            for (i=0; i<nprocs_node; i++){
+                tam_unpack_rank(i, process_node_list, &r_sizes, r_offsets + i * nrecvs, recv_buf, tam_rank_buf(&r_sizes, i, aggregate_buf));
+            }
+            timer->copy_time += MPI_Wtime() - start;
+        }
+        for (i=0; i<nprocs_node; i++){
+            /* Without threads, the messages for a local process are sent as soon as they are packed.*/
+            if (tam_copy_threads <= 1){
+                start = MPI_Wtime();
+                tam_unpack_rank(i, process_node_list, &r_sizes, r_offsets + i * nrecvs, recv_buf, tam_rank_buf(&r_sizes, i, aggregate_buf));
+                timer->copy_time += MPI_Wtime() - start;
             }
+            if ( i == 0 ){
+                continue;
+            }
+            // Figure out the total recv size of a local process.
+            temp = tam_rank_size(&r_sizes, i);
             // Do something when the target process is an aggregator.
             if (temp){
-                /*
-                  ptrs is the pointer to the buffer received from remote proxy processes. The messages are ordered by ranks of local ranks, then messages for each local rank are ordered by the source ranks (at remote nodes)
-                  ptrs[process_node_list[w]] means that we are trying to find the node that process w belongs to, so we can know which inter-node buffer we need to access.
-                  r_lens[i*nprocs+w] is the exclusive prefix-sum receive size of processlocal_ranks[i] from process w (with respect to comm)
-                */
-                ptr2 = ptr;
-                for (w=0; w<nprocs; w++){
-                    if ( i == nprocs_node -1 && w == nprocs -1 ){
-                        temp2 = node_recv_size - r_lens[i*nprocs+w];
-                    } else{
-                        temp2 = r_lens[i*nprocs+w+1] - r_lens[i*nprocs+w];
-                    }
-                    memcpy(ptr,ptrs[process_node_list[w]],sizeof(char)*temp2);
-                    // ptrs[process_node_list[w]] is in order, we can shift the pointer to the next location and access its content.
-                    ptrs[process_node_list[w]] += temp2;
-                    ptr += temp2;
-                }
-                MPI_Issend(ptr2, temp, MPI_BYTE, local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
+                issend_bytes(tam_rank_buf(&r_sizes, i, aggregate_buf), temp, local_ranks[i], local_ranks[i] + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
             }
         }
-    } else{
+        ADIOI_Free(r_offsets);
+    } else if (myrank!=local_ranks[0]){
+        /* The barrier of the size exchange of the proxies spans comm, the other processes enter it at once.*/
+        if (!tam_meta_collective){
+            MPI_Ibarrier(comm, &intra_req[j++]);
+        }
         if (total_recv_size){
-            MPI_Irecv(local_buf, total_recv_size, MPI_BYTE, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
+            irecv_bytes(local_buf, total_recv_size, local_ranks[0], myrank + local_ranks[0] + 100 * iter, comm, &intra_req[j++]);
         }
     }
     if (j) {
@@ -1286,16 +2297,17 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
 
     if (myrank==local_ranks[0]){
         ADIOI_Free(global_s_lens);
-        ADIOI_Free(s_lens); /*r_lens is freed together*/
+        tam_free_sizes(&s_sizes);
+        tam_free_sizes(&r_sizes);
         ADIOI_Free(ptrs);
-        ADIOI_Free(r_buf[0]);
+        comm_buf_free(r_buf[0]);
         ADIOI_Free(r_buf);
         if (node_recv_size || node_message_size){
-            ADIOI_Free(s_buf2);
+            comm_buf_free(s_buf2);
         }
     }
     if (aggregate_buffer_size){
-        ADIOI_Free(aggregate_buf);
+        comm_buf_free(aggregate_buf);
     }
     ADIOI_Free(intra_req);
     ADIOI_Free(intra_sts);
@@ -1308,6 +2320,260 @@ int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* l
     return 0;
 }
 
+/*
+  Bundles of the hierarchical exchange. A bundle is one contiguous buffer: the number of messages n, n (source, destination, size) triples and the
+  payloads of the n messages in the same order, all MPI_Aint except the payload.
+*/
+static MPI_Aint bundle_bytes(MPI_Aint n, MPI_Aint payload){
+    return (1 + 3 * n) * (MPI_Aint) sizeof(MPI_Aint) + payload;
+}
+
+/*
+  Distribute the messages of nbufs bundles among ntargets new bundles, message (src, dst) goes to bundle dst / divisor - first. The new bundles and
+  their sizes are returned in out and out_sizes, and the bytes of the new bundles are added to copy_bytes. With ntargets = 1 the bundles are merged.
+*/
+static int bundle_split(char **bufs, int nbufs, int divisor, int first, int ntargets, char **out, MPI_Aint *out_sizes, double *copy_bytes){
+    MPI_Aint *counts, *payloads, *fill, *rec, *orec, n, k, t;
+    char *data;
+    int b;
+    counts = (MPI_Aint*) ADIOI_Calloc(3 * ntargets, sizeof(MPI_Aint));
+    payloads = counts + ntargets;
+    fill = payloads + ntargets;
+    for ( b = 0; b < nbufs; b++ ){
+        n = ((MPI_Aint*) bufs[b])[0];
+        rec = (MPI_Aint*) bufs[b] + 1;
+        for ( k = 0; k < n; k++ ){
+            t = rec[3 * k + 1] / divisor - first;
+            counts[t]++;
+            payloads[t] += rec[3 * k + 2];
+        }
+    }
+    for ( t = 0; t < ntargets; t++ ){
+        out_sizes[t] = bundle_bytes(counts[t], payloads[t]);
+        out[t] = comm_buf_alloc(out_sizes[t]);
+        copy_bytes[0] += out_sizes[t];
+        ((MPI_Aint*) out[t])[0] = counts[t];
+        /* fill[t] counts the messages copied so far, payloads[t] becomes the payload offset.*/
+        payloads[t] = bundle_bytes(counts[t], 0);
+    }
+    for ( b = 0; b < nbufs; b++ ){
+        n = ((MPI_Aint*) bufs[b])[0];
+        rec = (MPI_Aint*) bufs[b] + 1;
+        data = bufs[b] + bundle_bytes(n, 0);
+        for ( k = 0; k < n; k++ ){
+            t = rec[3 * k + 1] / divisor - first;
+            orec = (MPI_Aint*) out[t] + 1 + 3 * fill[t];
+            orec[0] = rec[3 * k];
+            orec[1] = rec[3 * k + 1];
+            orec[2] = rec[3 * k + 2];
+            if (rec[3 * k + 2]){
+                memcpy(out[t] + payloads[t], data, rec[3 * k + 2]);
+            }
+            data += rec[3 * k + 2];
+            payloads[t] += rec[3 * k + 2];
+            fill[t]++;
+        }
+    }
+    ADIOI_Free(counts);
+    return 0;
+}
+
+/*
+  Send nsends bundles to send_peers and receive nrecvs bundles from recv_peers into new buffers in. The sizes go first, the time spent waiting is
+  added to wait_time.
+*/
+static int bundle_exchange(int nsends, int *send_peers, char **out, MPI_Aint *out_sizes, int nrecvs, int *recv_peers, char **in, int tag, MPI_Comm comm, double *wait_time){
+    MPI_Request *req;
+    MPI_Aint *in_sizes;
+    double start;
+    int i, j = 0;
+    req = (MPI_Request*) ADIOI_Malloc(sizeof(MPI_Request) * (nsends + nrecvs));
+    in_sizes = (MPI_Aint*) ADIOI_Malloc(sizeof(MPI_Aint) * (nrecvs + 1));
+    for ( i = 0; i < nrecvs; i++ ){
+        MPI_Irecv(in_sizes + i, 1, MPI_AINT, recv_peers[i], tag, comm, &req[j++]);
+    }
+    for ( i = 0; i < nsends; i++ ){
+        MPI_Isend(out_sizes + i, 1, MPI_AINT, send_peers[i], tag, comm, &req[j++]);
+    }
+    start = MPI_Wtime();
+    MPI_Waitall(j, req, MPI_STATUSES_IGNORE);
+    wait_time[0] += MPI_Wtime() - start;
+    j = 0;
+    for ( i = 0; i < nrecvs; i++ ){
+        in[i] = comm_buf_alloc(in_sizes[i]);
+        irecv_bytes(in[i], in_sizes[i], recv_peers[i], tag, comm, &req[j++]);
+    }
+    for ( i = 0; i < nsends; i++ ){
+        issend_bytes(out[i], out_sizes[i], send_peers[i], tag, comm, &req[j++]);
+    }
+    start = MPI_Wtime();
+    MPI_Waitall(j, req, MPI_STATUSES_IGNORE);
+    wait_time[0] += MPI_Wtime() - start;
+    ADIOI_Free(in_sizes);
+    ADIOI_Free(req);
+    return 0;
+}
+
+/*
+  Generalized hierarchical exchange with the same input and output as collective_write (receive sizes travel with the messages).
+  Level l groups level_sizes[l] consecutive ranks (every size a multiple of the previous one), the lowest rank of a group is its proxy.
+       1. Up: from the lowest level on, every group proxy gathers the bundles of the proxies of its subgroups (of all ranks at level 0).
+       2. Top: the proxies of the level nlevels - 1 groups exchange bundles, one per pair of groups (all ranks if nlevels is 0).
+       3. Down: from the highest level on, every group proxy splits its bundles by subgroup and forwards them to the subgroup proxies.
+  Messages are combined at every level, so only one bundle goes between two groups however many ranks they contain.
+*/
+int collective_write_hierarchical(int myrank, int nprocs, int nlevels, int *level_sizes, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm, Timer *timer){
+    char **list, **out, *data;
+    MPI_Aint *out_sizes, *rec, n, k, payload = 0;
+    double start;
+    int i, l, c, size, child, proxy, end, nlist, ngroups, ntargets, first, *peers, tag_base = iter * (2 * HIER_MAX_LEVELS + 1);
+    size = nlevels ? level_sizes[nlevels - 1] : 1;
+    ngroups = (nprocs + size - 1) / size;
+    /* At most one bundle per subgroup of the largest level, or per top level group.*/
+    list = (char**) ADIOI_Malloc(sizeof(char*) * (nprocs + 1));
+    out = (char**) ADIOI_Malloc(sizeof(char*) * (nprocs + 1));
+    out_sizes = (MPI_Aint*) ADIOI_Malloc(sizeof(MPI_Aint) * (nprocs + 1));
+    peers = (int*) ADIOI_Malloc(sizeof(int) * (nprocs + 1));
+
+    /* Bundle of the messages of this process.*/
+    start = MPI_Wtime();
+    n = 0;
+    for ( i = 0; i < nprocs; i++ ){
+        if (send_size[i]){
+            n++;
+            payload += send_size[i];
+        }
+    }
+    list[0] = comm_buf_alloc(bundle_bytes(n, payload));
+    ((MPI_Aint*) list[0])[0] = n;
+    rec = (MPI_Aint*) list[0] + 1;
+    data = list[0] + bundle_bytes(n, 0);
+    for ( i = 0; i < nprocs; i++ ){
+        if (send_size[i]){
+            rec[0] = myrank;
+            rec[1] = i;
+            rec[2] = send_size[i];
+            memcpy(data, send_buf[i], send_size[i]);
+            data += send_size[i];
+            rec += 3;
+        }
+    }
+    nlist = 1;
+    timer->copy_time += MPI_Wtime() - start;
+    timer->copy_bytes += payload;
+
+    /* Up*/
+    for ( l = 0; l < nlevels; l++ ){
+        child = l ? level_sizes[l - 1] : 1;
+        if (myrank % child){
+            break;
+        }
+        proxy = myrank / level_sizes[l] * level_sizes[l];
+        if (myrank != proxy){
+            start = MPI_Wtime();
+            bundle_split(list, nlist, nprocs, 0, 1, out, out_sizes, &(timer->copy_bytes));
+            for ( i = 0; i < nlist; i++ ){
+                comm_buf_free(list[i]);
+            }
+            timer->copy_time += MPI_Wtime() - start;
+            bundle_exchange(1, &proxy, out, out_sizes, 0, NULL, NULL, tag_base + l, comm, &(timer->recv_wait_all_time));
+            comm_buf_free(out[0]);
+            nlist = 0;
+            break;
+        }
+        end = proxy + level_sizes[l] < nprocs ? proxy + level_sizes[l] : nprocs;
+        c = 0;
+        for ( i = proxy + child; i < end; i += child ){
+            peers[c++] = i;
+        }
+        bundle_exchange(0, NULL, NULL, NULL, c, peers, list + nlist, tag_base + l, comm, &(timer->recv_wait_all_time));
+        nlist += c;
+    }
+
+    /* Top*/
+    if (nlist && myrank % size == 0){
+        start = MPI_Wtime();
+        bundle_split(list, nlist, size, 0, ngroups, out, out_sizes, &(timer->copy_bytes));
+        for ( i = 0; i < nlist; i++ ){
+            comm_buf_free(list[i]);
+        }
+        timer->copy_time += MPI_Wtime() - start;
+        c = 0;
+        for ( i = 0; i < ngroups; i++ ){
+            if (i * size != myrank){
+                peers[c] = i * size;
+                out[c] = out[i];
+                out_sizes[c] = out_sizes[i];
+                c++;
+            } else {
+                list[0] = out[i];
+            }
+        }
+        bundle_exchange(c, peers, out, out_sizes, c, peers, list + 1, tag_base + HIER_MAX_LEVELS, comm, &(timer->send_wait_all_time));
+        for ( i = 0; i < c; i++ ){
+            comm_buf_free(out[i]);
+        }
+        nlist = c + 1;
+    }
+
+    /* Down*/
+    for ( l = nlevels - 1; l >= 0; l-- ){
+        child = l ? level_sizes[l - 1] : 1;
+        if (myrank % child){
+            continue;
+        }
+        proxy = myrank / level_sizes[l] * level_sizes[l];
+        if (myrank != proxy){
+            /* The first level at which this process is not a proxy is where it receives its bundle.*/
+            if (nlist == 0){
+                bundle_exchange(0, NULL, NULL, NULL, 1, &proxy, list, tag_base + HIER_MAX_LEVELS + 1 + l, comm, &(timer->recv_wait_all_time));
+                nlist = 1;
+            }
+            continue;
+        }
+        end = proxy + level_sizes[l] < nprocs ? proxy + level_sizes[l] : nprocs;
+        first = proxy / child;
+        ntargets = (end - proxy + child - 1) / child;
+        start = MPI_Wtime();
+        bundle_split(list, nlist, child, first, ntargets, out, out_sizes, &(timer->copy_bytes));
+        for ( i = 0; i < nlist; i++ ){
+            comm_buf_free(list[i]);
+        }
+        timer->copy_time += MPI_Wtime() - start;
+        list[0] = out[0];
+        nlist = 1;
+        for ( i = 1; i < ntargets; i++ ){
+            peers[i - 1] = (first + i) * child;
+        }
+        bundle_exchange(ntargets - 1, peers, out + 1, out_sizes + 1, 0, NULL, NULL, tag_base + HIER_MAX_LEVELS + 1 + l, comm, &(timer->recv_wait_all_time));
+        for ( i = 1; i < ntargets; i++ ){
+            comm_buf_free(out[i]);
+        }
+    }
+
+    /* All bundles left are addressed to this process.*/
+    start = MPI_Wtime();
+    for ( c = 0; c < nlist; c++ ){
+        n = ((MPI_Aint*) list[c])[0];
+        rec = (MPI_Aint*) list[c] + 1;
+        data = list[c] + bundle_bytes(n, 0);
+        for ( k = 0; k < n; k++ ){
+            if (rec[3 * k + 2]){
+                memcpy(recv_buf[rec[3 * k]], data, rec[3 * k + 2]);
+            }
+            data += rec[3 * k + 2];
+            timer->copy_bytes += rec[3 * k + 2];
+        }
+        comm_buf_free(list[c]);
+    }
+    timer->copy_time += MPI_Wtime() - start;
+    ADIOI_Free(peers);
+    ADIOI_Free(out_sizes);
+    ADIOI_Free(out);
+    ADIOI_Free(list);
+    return 0;
+}
+
 int collective_write_benchmark(int myrank, int nprocs, int *recv_size, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm){
     int i, j = 0;
     MPI_Request *req = (MPI_Request *) ADIOI_Malloc(2 * nprocs * sizeof(MPI_Request));
@@ -1339,7 +2605,7 @@ int create_recv_type(int nprocs, char** recv_buf, int* recv_size, int* local_agg
         for ( w = 0; w < nprocs; w++ ){
             if (local_aggregators[i] == process_aggregator_list[w] ){
                 array_of_blocklengths[j] = recv_size[w];
-                MPI_Address(recv_buf[w], array_of_displacements + j);
+                MPI_Get_address(recv_buf[w], array_of_displacements + j);
                 j++;
             }
         }
@@ -1412,99 +2678,3 @@ int reorder_ranklist(int *process_node_list, int *ranklist, int cb_nodes, int nr
     ADIOI_Free(node_index);
     return 0;
 }
-
-#if DEBUG==1
-/*----< main() >-------------------------------------------------------------*/
-int main(int argc, char** argv){
-    int rank, nprocs, i, blocklen = 0, ntimes = 0, type = 0, rank_assignment = 0, co = 0;
-    int* local_ranks, *global_receivers, *node_size, *process_node_list, *global_aggregators, *process_aggregator_list, *local_aggregators, *aggregator_local_ranks, is_aggregator, is_aggregator_new=0;
-    int nprocs_node, nrecvs, global_aggregator_size, local_aggregator_size, nprocs_aggregator, iter = 1;
-    int *recv_size, *send_size;
-    char **recv_buf, **send_buf;
-    MPI_Datatype* recv_types;
-
-    /* command-line arguments */
-    while ((i = getopt(argc, argv, "hp:b:n:t:r:c:")) != EOF){
-        switch(i) {
-            case 'p': nprocs_node = atoi(optarg);
-                      break;
-            case 'b': blocklen = atoi(optarg);
-                      break;
-            case 'n': ntimes = atoi(optarg);
-                      break;
-            case 't': type = atoi(optarg);
-                      break;
-            case 'r': rank_assignment = atoi(optarg);
-                      break;
-            case 'c': co = atoi(optarg);
-                      break;
-            case 'h':
-            default:  if (rank==0) usage();
-                      MPI_Finalize();
-                      return 1;
-        }
-    }
-    MPI_Comm comm = MPI_COMM_WORLD, intra_comm;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
-    //gather_node_information(rank, nprocs, &nprocs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list, comm);
-    static_node_assignment(rank, nprocs, rank_assignment, &nprocs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
-    if ( rank == 0 ){
-        printf("blocklen = %d, nprocs_node = %d, rank_assignment = %d, type = %d, co = %d\n",blocklen, nprocs_node, rank_assignment, type, co);
-    }
-/*
-    if (rank==2){
-        printf("nrecvs=%d, nprocs_node=%d\n",nrecvs, nprocs_node);
-        for (i=0; i < nrecvs; i++){
-            printf("global_receivers[%d]=%d, node_size[%d]=%d\n",i,global_receivers[i],i,node_size[i]);
-        }
-        for (i=0; i < nprocs_node; i++){
-            printf("local_ranks[%d]=%d\n",i,local_ranks[i]);
-        }
-        for (i=0; i < nprocs; i++){
-            printf("process_node_list[%d]=%d\n",i,process_node_list[i]);
-        }
-    }
-*/
-    initialize_setting(rank, nprocs, local_ranks, global_receivers, nrecvs, blocklen, &recv_size, &send_size, &recv_buf, &send_buf, &global_aggregators, &global_aggregator_size, &is_aggregator, type);
-    aggregator_meta_information(rank, process_node_list, nprocs, nrecvs, global_aggregator_size, global_aggregators, co, &is_aggregator_new, &local_aggregator_size, &local_aggregators, &nprocs_aggregator, &aggregator_local_ranks, &process_aggregator_list, 0);
-/*
-    if ( rank == 0 ){
-        printf("total number of aggregators %d\n",local_aggregator_size);
-        for ( i = 0; i < local_aggregator_size; i++ ){
-            printf("local_aggregators[%d] = %d\n",i, local_aggregators[i]);
-        }
-        for ( i = 0; i < global_aggregator_size; i++ ){
-            printf("global_aggregators[%d] = %d\n",i, global_aggregators[i]);
-        }
-        for ( i = 0; i < nprocs; i++) {
-            printf("process_aggregator_list[%d]=%d, process_node_list[%d]=%d\n",i, process_aggregator_list[i], i, process_node_list[i]);
-        }
-    }
-    MPI_Barrier(MPI_COMM_WORLD);
-    printf("rank =%d, is_local_aggregator = %d, is_global_aggregator = %d\n",rank, is_aggregator_new, is_aggregator);
-*/
-    create_recv_type(nprocs, recv_buf, recv_size, local_aggregators, local_aggregator_size, process_aggregator_list, &recv_types);
-    MPI_Comm_split(MPI_COMM_WORLD, process_aggregator_list[rank], rank, &intra_comm);
-    /* MPI INFO for RMA*/
-    MPI_Info win_info;
-    MPI_Info_create(&win_info);
-    MPI_Info_set(win_info, "alloc_shared_contig", "true");
-
-/*
-    reorder_ranklist(process_node_list, global_aggregators, global_aggregator_size, nrecvs);
-    collective_write2(rank, nprocs, nprocs_aggregator, global_aggregator_size, local_aggregator_size, is_aggregator, is_aggregator_new, aggregator_local_ranks, global_aggregators, local_aggregators, process_aggregator_list, recv_size, send_size, recv_types, send_buf, iter, comm);
-    clean_recv_type(local_aggregator_size, recv_types);
-*/
-    collective_write(rank, nprocs, nprocs_node, nrecvs, local_ranks, global_receivers, process_node_list, recv_size, send_size, recv_buf, send_buf, iter, comm);
-    //collective_write_benchmark(rank, nprocs, recv_size, send_size, recv_buf, send_buf, 1, comm);
-    test_correctness(rank, nprocs, recv_size, recv_buf);
-    clean_up(nprocs, &recv_size, &send_size, &recv_buf, &send_buf);
-    clean_aggregator_meta(is_aggregator_new, aggregator_local_ranks, local_aggregators, process_aggregator_list);
-    MPI_Comm_free(&intra_comm);
-    MPI_Finalize();
-    return 0;
-}
-#endif
-
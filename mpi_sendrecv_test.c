@@ -12,6 +12,9 @@
 #include <string.h>
 #include <math.h>
 
+/* Messages per round when the per-message overhead is calibrated.*/
+#define CALIBRATE_MESSAGES 64
+
 int pt2pt_statistics(int rank, int nprocs, int data_size, int ntimes, int runs){
     double total_start, total_timing, mean, var, std;
     int i, m, dst;
@@ -73,13 +76,86 @@ int pt2pt_statistics(int rank, int nprocs, int data_size, int ntimes, int runs){
 
 }
 
+/*
+  Time of one round of rank 1 sending nmessages messages of data_size bytes to rank 0 (Issend, Waitall), averaged over runs.
+*/
+static double round_time(int rank, int nmessages, int data_size, int runs, char *buf, MPI_Request *requests){
+    double start;
+    int i, j;
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    for ( i = 0; i < runs; ++i ) {
+        for ( j = 0; j < nmessages; ++j ) {
+            if ( rank == 0 ) {
+                MPI_Irecv(buf, data_size, MPI_BYTE, 1, j, MPI_COMM_WORLD, &requests[j]);
+            } else {
+                MPI_Issend(buf, data_size, MPI_BYTE, 0, j, MPI_COMM_WORLD, &requests[j]);
+            }
+        }
+        MPI_Waitall(nmessages, requests, MPI_STATUSES_IGNORE);
+    }
+    start = (MPI_Wtime() - start) / runs;
+    MPI_Bcast(&start, 1, MPI_DOUBLE, 1, MPI_COMM_WORLD);
+    return start;
+}
+
+/*
+  Calibrate the cost model of mpi_test -A between two processes and write it to filename.
+  A round of one empty message takes alpha + overhead, every further message of the round adds overhead and every byte adds beta.
+  gamma is the time memcpy takes per byte.
+*/
+int calibrate_cost_model(int rank, int nprocs, int data_size, int runs, char *filename){
+    double single, many, large, start, alpha, overhead, beta, gamma;
+    char *buf, *copy;
+    MPI_Request requests[CALIBRATE_MESSAGES];
+    FILE* stream;
+    int i;
+    if (nprocs != 2) {
+        if (rank == 0) {
+            printf("the cost model is calibrated between 2 processes\n");
+        }
+        return 1;
+    }
+    buf = (char*) calloc(data_size, sizeof(char));
+    copy = (char*) calloc(data_size, sizeof(char));
+    round_time(rank, 1, 0, runs, buf, requests);
+    single = round_time(rank, 1, 0, runs, buf, requests);
+    many = round_time(rank, CALIBRATE_MESSAGES, 0, runs, buf, requests);
+    large = round_time(rank, 1, data_size, runs, buf, requests);
+    start = MPI_Wtime();
+    for ( i = 0; i < runs; ++i ) {
+        memcpy(copy, buf, data_size);
+        buf[i % data_size] = copy[(i + 1) % data_size];
+    }
+    gamma = (MPI_Wtime() - start) / runs / data_size;
+    overhead = (many - single) / (CALIBRATE_MESSAGES - 1);
+    if (overhead < 0) {
+        overhead = 0;
+    }
+    alpha = single > overhead ? single - overhead : single;
+    beta = large > single ? (large - single) / data_size : 0;
+    if (rank == 0) {
+        printf("alpha = %e s, overhead = %e s, beta = %e s/byte (%lf MiB/s), gamma = %e s/byte (%lf MiB/s)\n", alpha, overhead, beta, beta > 0 ? 1 / beta / 1048576 : 0, gamma, gamma > 0 ? 1 / gamma / 1048576 : 0);
+        stream = fopen(filename,"w");
+        fprintf(stream, "alpha = %e\n", alpha);
+        fprintf(stream, "overhead = %e\n", overhead);
+        fprintf(stream, "beta = %e\n", beta);
+        fprintf(stream, "gamma = %e\n", gamma);
+        fclose(stream);
+    }
+    free(buf);
+    free(copy);
+    return 0;
+}
+
 int main(int argc, char **argv){
     int rank, procs, i, ntimes = 0, data_size = 0, runs = 0;
     long long int statuses, status;
+    char *model_file = NULL;
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD,&rank);
     MPI_Comm_size(MPI_COMM_WORLD,&procs);
-    while ((i = getopt(argc, argv, "hk:d:i:")) != EOF){
+    while ((i = getopt(argc, argv, "hk:d:i:c:")) != EOF){
         switch(i) {
             case 'd': 
                 data_size = atoi(optarg);
@@ -90,11 +166,19 @@ int main(int argc, char **argv){
             case 'i': 
                 runs = atoi(optarg);
                 break;
+            case 'c':
+                model_file = optarg;
+                break;
             default:
                 MPI_Finalize();
       	        return 0;
         }
     }
+    if (model_file) {
+        calibrate_cost_model(rank, procs, data_size > 0 ? data_size : 1048576, runs > 0 ? runs : 100, model_file);
+        MPI_Finalize();
+        return 0;
+    }
     statuses = (long long int)MPI_STATUSES_IGNORE;
     status = (long long int)MPI_STATUS_IGNORE;
     printf("status = %lld, statuses = %lld\n", status, statuses);
@@ -11,6 +11,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <stddef.h> /* offsetof() */
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#endif
+#include <fcntl.h> /* open() */
+#include <pthread.h>
+#include <time.h> /* nanosleep() */
+#include "benchmark.h"
 #define DEBUG 0
 #define ERR { \
     if (err != MPI_SUCCESS) { \
@@ -21,23 +32,161 @@
     } \
 }
 #define MAP_DATA(a,b,c,d) (a+b+c+d)
+#define FILL_THREAD_THRESHOLD 1048576
+#define WORKLOAD_UNIFORM 0
+#define WORKLOAD_RANDOM 1
+#define WORKLOAD_ZIPF 2
+#define WORKLOAD_SPARSE 3
+#define WORKLOAD_HOT 4
+#define WORKLOAD_TRACE 5
+#define WORKLOAD_STRIPE 6
+#define IO_NONE 0
+#define IO_PWRITE 1
+#define IO_MPI 2
+#define NODE_ASSIGNMENT_NUMA 2
+#define HIER_MAX_LEVELS 8
+#define COMM_BUF_MALLOC 0
+#define COMM_BUF_POOL 3
+#ifndef STREAM_SLOTS
+#define STREAM_SLOTS 8
+#endif
+#ifndef PROGRESS_MIN_BACKOFF
+#define PROGRESS_MIN_BACKOFF 1000
+#endif
+#ifndef PROGRESS_MAX_BACKOFF
+#define PROGRESS_MAX_BACKOFF 100000
+#endif
 
 typedef struct{
-    double post_request_time;
-    double send_wait_all_time;
-    double recv_wait_all_time;
-    double barrier_time;
-    double total_time;
-}Timer;
+    int type;
+    int seed;
+    double param;
+    /* Size tables of the table-driven workloads (trace phase, stripe model), indexed by aggregator position (sends) and by source rank (receives).*/
+    int table_rank;
+    int *send_table;
+    int *recv_table;
+    /* File access pattern of the stripe model, the stripe size and count are shared with the I/O mode.*/
+    int pattern;
+    int nblocks;
+    /* Volume of the replayed trace phase summed over all processes, 0 outside a replay.*/
+    long long total_bytes;
+}Workload;
+
+/* Two-phase I/O mode: after an all-to-many exchange every aggregator writes what it received to path.*/
+typedef struct{
+    int method;
+    int stripe_size;
+    int stripe_count;
+    char path[200];
+}IO_setting;
+
+/* Parameters of the cost model (-A), calibrated by mpi_sendrecv_test -c: seconds per round, per message, per byte sent or received and per byte copied.*/
+typedef struct{
+    double alpha;
+    double overhead;
+    double beta;
+    double gamma;
+    int loaded;
+}Cost_model;
+
+/* Values of an option that takes a list of values and ranges (-a, -d, -c, -m).*/
+typedef struct{
+    int *values;
+    int count;
+}Sweep;
 
+/* One record of a replay trace file, stored as four native 32-bit integers.*/
+typedef struct{
+    int src;
+    int dst;
+    int bytes;
+    int phase;
+}Trace_record;
 
 extern int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int *nrecvs, int** node_size, int** local_ranks, int** global_receivers, int **process_node_list);
 
-extern int aggregator_meta_information(int rank, int *process_node_list, int nprocs, int nrecvs, int global_aggregator_size, int *global_aggregators, int co, int* is_aggregator_new, int* local_aggregator_size, int **local_aggregators, int* nprocs_aggregator, int **aggregator_local_ranks, int **process_aggregator_list, int mode);
+extern int aggregator_meta_information(int rank, int *process_node_list, int nprocs, int nrecvs, int global_aggregator_size, int *global_aggregators, int co, int *co_node, int* is_aggregator_new, int* local_aggregator_size, int **local_aggregators, int* nprocs_aggregator, int **aggregator_local_ranks, int **process_aggregator_list, int mode);
+
+extern int stripe_model_aggregators(int cb_nodes, int stripe_count);
+
+extern int stripe_model_sizes(int rank, int nprocs, int avail_cb_nodes, int agg_index, Stripe_model *model, int *send_size, int *recv_size);
+
+extern int tam_copy_threads;
+
+extern int tam_waitsome;
+
+extern int tam_meta_collective;
+
+extern int comm_buf_mode;
+
+extern int comm_buf_first_touch;
+
+extern double comm_buf_touch_time;
+
+extern int tam_numa_domains;
+
+extern char *comm_buf_alloc(MPI_Aint size);
+
+extern void comm_buf_free(char *buf);
+
+extern int comm_buf_release();
+
+extern double net_emu_latency;
+
+extern double net_emu_bandwidth;
+
+extern int net_emulation_init(int ppn);
+
+extern long long net_messages_sent;
+
+extern long long net_messages_received;
+
+extern long long net_bytes_sent;
+
+extern long long net_bytes_received;
+
+extern long long net_rounds;
+
+extern int net_count_traffic;
+
+extern int schedule_aggregators(int procs, int cb_nodes, int proc_node, int type, int *rank_list);
+
+extern int schedule_node_robin(int procs, int proc_node, int *map);
+
+extern int schedule_balanced_start(int rank, int procs, int cb_nodes);
+
+extern int schedule_balanced_source(int myindex, int procs, int cb_nodes, int k, int i);
+
+extern int schedule_balanced_sends(int rank, int procs, int cb_nodes, int k, int comm_size, int *send_start, int *targets);
+
+extern int schedule_scattered_source(int rank, int procs, int k, int i);
+
+extern int schedule_scattered_dest(int rank, int procs, int k, int i);
+
+extern int collective_write_hierarchical(int myrank, int nprocs, int nlevels, int *level_sizes, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm, Timer *timer);
+
+extern int collective_write_prepare(int myrank, int *local_ranks, int *process_node_list, MPI_Comm comm);
 
 extern int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* local_ranks, int* global_receivers, int *process_node_list, int *recv_size, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm, Timer *timer);
 
 int err;
+Workload workload = {WORKLOAD_UNIFORM, 0, 0, 0, NULL, NULL, 0, 1, 0};
+IO_setting io_setting = {IO_NONE, 1048576, 1, ""};
+Cost_model cost_model = {0, 0, 0, 0, 0};
+int verify = 1;
+/* Threads per rank of the MPI_THREAD_MULTIPLE methods (21, 22).*/
+int mpi_threads = 1;
+/* Run every method with a progress thread (-P).*/
+int progress_mode = 0;
+/* Set when MPI provides MPI_THREAD_MULTIPLE, which the progress thread needs.*/
+int progress_available = 0;
+/* Repetitions in flight of the pipelined methods (24, 25).*/
+int pipeline_depth = 1;
+/* Group sizes of the levels of the hierarchical methods (28, 29), -L. hier_nlevels < 0: one level of -p ranks.*/
+int hier_levels[HIER_MAX_LEVELS];
+int hier_nlevels = -1;
+/* Bytes of send and receive ring per process of the streaming methods (26, 27).*/
+int stream_window = 4194304;
 static void
 usage(char *argv0)
 {
@@ -48,6 +197,8 @@ usage(char *argv0)
     "       [-p] number of processes per node (does not really matter)\n"  
     "       [-d] data size\n"
     "       [-c] maximum communication size\n"
+    "            -a, -d, -c and -m take lists of values and ranges, e.g. 1,2,4 or 1:256:x2 (doubling) or 0:1024:256 (step 256),\n"
+    "            every combination is run in one MPI session\n"
     "       [-i] number of experiments (MPI barrier between experiments)\n"
     "       [-k] number of iteration (run methods many times, there is no sync between individual runs)\n"
     "       [-m] method\n"
@@ -64,161 +215,437 @@ usage(char *argv0)
     "           10: Many to all pairwise (many-to-all pairwise)\n"
     "           11: Many to all half sync (many-to-all half sync)\n"
     "           12: Many to all half sync2 (many-to-all half sync2)\n"
+    "           21: All to many with -H threads per process (all-to-many threaded), ignores -c\n"
+    "           22: Many to all with -H threads per process (many-to-all threaded), ignores -c\n"
+    "           23: All to many overlapped with computation, progress thread off and on (all-to-many overlap), ignores -c\n"
+    "           24: All to many with -D repetitions in flight (all-to-many pipelined), ignores -c\n"
+    "           25: Many to all with -D repetitions in flight (many-to-all pipelined), ignores -c\n"
+    "           26: All to many streamed through a -S byte ring (all-to-many streaming)\n"
+    "           27: Many to all streamed through a -S byte ring (many-to-all streaming)\n"
+    "           28: All to many combined at every level of -L (all-to-many hierarchical), ignores -c\n"
+    "           29: Many to all combined at every level of -L (many-to-all hierarchical), ignores -c\n"
+    "       [-w] workload of per-pair message sizes\n"
+    "           0: uniform, every pair is data size (default)\n"
+    "           1: uniform-random in [0, 2 * data size]\n"
+    "           2: Zipf-skewed aggregator file domains (-z exponent, default 1)\n"
+    "           3: sparse, a fraction of pairs is empty (-z fraction, default 0.5)\n"
+    "           4: hot aggregator (-z factor, default 8)\n"
+    "           6: Lustre stripe model, every process accesses -y blocks of data size bytes, striped by -g and -q\n"
+    "           every pair is cut to 2 GiB - 1 bytes\n"
+    "       [-s] workload seed\n"
+    "       [-z] workload parameter\n"
+    "       [-x] access pattern of the stripe model, 0: contiguous (default), 1: strided, 2: block-cyclic (-z blocks per cycle, default 2)\n"
+    "       [-y] number of blocks per process of the stripe model (default 1)\n"
+    "       [-o] write the file domains of all-to-many aggregators to this file (two-phase I/O mode)\n"
+    "       [-e] I/O method of -o, 1: pwrite (default), 2: MPI_File_write_at\n"
+    "       [-g] stripe size of -o in bytes (default 1048576)\n"
+    "       [-q] stripe count of -o (default 1)\n"
+    "       [-v] verify received data after every experiment, 1: on (default), 0: off\n"
+    "       [-T] number of OpenMP threads a TAM proxy uses to pack and unpack messages (default 1)\n"
+    "       [-W] 1: a TAM proxy unpacks the message of every node as soon as it arrives (MPI_Waitsome), 0: after the whole exchange (default)\n"
+    "       [-C] 1: TAM exchanges its sizes with MPI_Gatherv and MPI_Ialltoall on cached node and proxy communicators, 0: point-to-point (default)\n"
+    "       [-H] threads per process of methods 21 and 22, initializes MPI with MPI_THREAD_MULTIPLE if greater than 1 (default 1)\n"
+    "       [-P] 1: run every method with a progress thread per process, 0: off (default)\n"
+    "       [-D] repetitions (-k) in flight of methods 24 and 25, each on its own communicator (default 1)\n"
+    "       [-S] bytes of send and receive ring per process of methods 26 and 27 (default 4194304)\n"
+    "       [-M] allocator of communication buffers, 0: malloc (default), 1: MPI_Alloc_mem, 2: huge pages (mmap), 3: cached pool\n"
+    "       [-N] NUMA domains per -p node of the TAM methods, each with its own proxy, -1: read from sysfs, 0: off (default)\n"
+    "       [-L] comma separated group sizes of the levels of methods 28 and 29, e.g. 2,8,64, at most 8 levels (default -p)\n"
+    "       [-A] cost model parameters written by pt2pt_test -c, every method prints its predicted time next to the measured one\n"
+    "       [-E] emulate a network between the -p nodes of one host, latency in microseconds,bandwidth per node in MiB/s (0: unlimited), e.g. 2,10000\n"
+    "       [-f] replay a (src, dst, bytes, phase) trace file, every phase is run with the all-to-many method(s) given by -m\n"
     ;
     fprintf(stderr, help, argv0);
 }
 
+/*
+ * Every payload byte is (char) MAP_DATA(rank, i, seed, iter), so any 256 consecutive bytes of a message are a window of this ramp.
+*/
+static char pattern_ramp[512];
+
+static void pattern_init(){
+    static int initialized = 0;
+    int i;
+    if (initialized){
+        return;
+    }
+    for ( i = 0; i < 512; ++i ){
+        pattern_ramp[i] = (char) i;
+    }
+    initialized = 1;
+}
+
+/*
+ * Generate the payload by copying 256-byte windows of the ramp (memcpy moves them at full SIMD width).
+ * Buffers of at least FILL_THREAD_THRESHOLD bytes are split among the OpenMP threads (see fill_messages for many small ones).
+*/
 int fill_buffer(int rank, char *buf, int size, int seed, int iter){
     MPI_Count i;
-    for ( i = 0; i < size; ++i ){
-        buf[i] = (char) MAP_DATA(rank,i, seed, iter);
+    pattern_init();
+    #pragma omp parallel for schedule(static) if (size >= FILL_THREAD_THRESHOLD)
+    for ( i = 0; i < size; i += 256 ){
+        memcpy(buf + i, pattern_ramp + (MAP_DATA(rank, i, seed, iter) & 255), size - i < 256 ? size - i : 256);
+    }
+    return 0;
+}
+
+/*
+ * Fill count consecutive messages, message i is generated with seed i. FILL_THREAD_THRESHOLD applies to the total volume:
+ * many small messages are dealt to the OpenMP threads here, a single large one is split inside fill_buffer.
+*/
+int fill_messages(int rank, char **buf, int *lens, int count, int iter){
+    MPI_Aint total = 0;
+    int i, largest = 0;
+    pattern_init();
+    for ( i = 0; i < count; ++i ){
+        total += lens[i];
+        largest = lens[i] > largest ? lens[i] : largest;
+    }
+    #pragma omp parallel for schedule(dynamic, 16) if (total >= FILL_THREAD_THRESHOLD && largest < FILL_THREAD_THRESHOLD)
+    for ( i = 0; i < count; ++i ){
+        fill_buffer(rank, buf[i], lens[i], i, iter);
     }
     return 0;
 }
 
 /*
- * Check if current buffer has correct message or not.
+ * Check if current buffer has correct message or not. Returns the number of wrong bytes.
  * rank is not the current process rank, it is actually the rank of the remote sender.
+ * The message is compared 256 bytes at a time against the ramp, bytes are only inspected one by one inside a window that differs.
 */
 int check_buffer(int rank, char* buf, int size, int seed, int iter){
-    MPI_Count i;
-    for ( i = 0; i < size; ++i ) {
-        if ( ((char) MAP_DATA(rank,i, seed, iter)) != buf[i] ){
-            printf("%d,%d\n",(int)((char)MAP_DATA(rank,i, seed, iter)), (int)buf[i]);
-            return 1;
+    MPI_Count i, j, n;
+    int offset, wrong = 0;
+    pattern_init();
+    for ( i = 0; i < size; i += n ){
+        n = size - i < 256 ? size - i : 256;
+        offset = (int) (MAP_DATA(rank, i, seed, iter) & 255);
+        if (memcmp(buf + i, pattern_ramp + offset, n)){
+            for ( j = 0; j < n; ++j ){
+                wrong += buf[i + j] != pattern_ramp[offset + j];
+            }
         }
     }
-    return 0;
+    return wrong;
+}
+
+/*
+ * Seeded generator for per-pair message sizes. A pair is a non-aggregator side rank and the aggregator at position agg_index of rank_list.
+ * Both ends of a message evaluate the same pair independently, so the size must only depend on the arguments and the workload settings.
+ *   0: uniform, every pair is data_size.
+ *   1: uniform-random, sizes are drawn from [0, 2 * data_size].
+ *   2: Zipf-skewed, aggregator file domains follow a Zipf distribution with exponent param (mean pair size is data_size).
+ *   3: sparse, a random fraction param of pairs is empty, the rest are data_size.
+ *   4: hot-aggregator, one aggregator (chosen by seed) receives param times data_size from every process.
+ *   5: trace, sizes of the current phase of a replayed trace (see load_trace).
+ *   6: stripe model, sizes follow from the file offsets every rank touches and the Lustre striping (see stripe_model_setup).
+*/
+static unsigned long long workload_hash(int seed, int a, int b){
+    unsigned long long x = ((unsigned long long) (unsigned) seed << 32) ^ ((unsigned long long) (unsigned) a << 16) ^ (unsigned long long) (unsigned) b;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static double workload_uniform(int seed, int a, int b){
+    return (workload_hash(seed, a, b) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int workload_pair_size(int rank, int agg_index, int cb_nodes, int data_size){
+    static int zipf_cb_nodes = 0;
+    static double zipf_param = 0, zipf_norm = 0;
+    double size;
+    int i;
+    switch (workload.type) {
+        case WORKLOAD_RANDOM :
+            size = workload_uniform(workload.seed, rank, agg_index) * (2.0 * data_size + 1);
+            break;
+        case WORKLOAD_ZIPF :
+            if (zipf_cb_nodes != cb_nodes || zipf_param != workload.param){
+                zipf_norm = 0;
+                for ( i = 1; i <= cb_nodes; ++i ){
+                    zipf_norm += pow(i, -workload.param);
+                }
+                zipf_cb_nodes = cb_nodes;
+                zipf_param = workload.param;
+            }
+            /* Popularity order of the aggregators is rotated by seed, so the heaviest file domain is not always rank_list[0].*/
+            i = ((agg_index + workload.seed) % cb_nodes + cb_nodes) % cb_nodes;
+            size = (double) data_size * cb_nodes * pow(i + 1, -workload.param) / zipf_norm;
+            break;
+        case WORKLOAD_SPARSE :
+            size = workload_uniform(workload.seed, rank, agg_index) < workload.param ? 0 : data_size;
+            break;
+        case WORKLOAD_HOT :
+            size = agg_index == (workload.seed % cb_nodes + cb_nodes) % cb_nodes ? workload.param * data_size : data_size;
+            break;
+        case WORKLOAD_TRACE :
+        case WORKLOAD_STRIPE :
+            /* Only the two ends of a pair ever ask for its size, so the tables of this rank cover every query.*/
+            if (rank == workload.table_rank){
+                size = workload.send_table[agg_index];
+            } else {
+                size = workload.recv_table[rank];
+            }
+            break;
+        default :
+            size = data_size;
+            break;
+    }
+    /* Message lengths are int throughout (fill_buffer, s_lens/r_lens, MPI_INT size lists of TAM), so one pair stays below 2 GiB.*/
+    if (size > INT_MAX){
+        size = INT_MAX;
+    }
+    return (int) size;
 }
 
-int prepare_many_to_all_data(char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int *myindex, int* s_len, int **r_lens, int rank, int procs, int isagg, int cb_nodes, int *rank_list, int data_size, int iter){
+int prepare_many_to_all_data(char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int *myindex, int **s_lens, int **r_lens, int rank, int procs, int isagg, int cb_nodes, int *rank_list, int data_size, int iter, Timer *timer){
+    double start = MPI_Wtime();
     int i;
-    MPI_Aint r_len;
-    int span = 1;
-    *s_len = (rank % span + 1) * data_size;
+    MPI_Aint r_len, s_len;
     *r_lens = (int*) malloc(sizeof(int) * cb_nodes);
+    *s_lens = NULL;
 
     if (isagg){
-        *requests = (MPI_Request*) malloc(sizeof(MPI_Request) * (cb_nodes + procs * 2));
-        *status = (MPI_Status*) malloc(sizeof(MPI_Status) * (cb_nodes + procs * 2));
-        *send_buf = (char**) malloc(sizeof(char*) * procs);
-        send_buf[0][0] = (char*) malloc(sizeof(char) * s_len[0] * procs);
-        fill_buffer(rank, send_buf[0][0], s_len[0], 0,iter);
-        for ( i = 1; i < procs; ++i ){
-            send_buf[0][i] = send_buf[0][i-1] + s_len[0];
-            fill_buffer(rank, send_buf[0][i], s_len[0],i,iter);
-        }
         for ( i = 0; i < cb_nodes; ++i ){
             if (rank_list[i] == rank){
                 *myindex = i;
             }
         }
+        *requests = (MPI_Request*) malloc(sizeof(MPI_Request) * (cb_nodes + procs * 2));
+        *status = (MPI_Status*) malloc(sizeof(MPI_Status) * (cb_nodes + procs * 2));
+        *s_lens = (int*) malloc(sizeof(int) * procs);
+        s_len = 0;
+        for ( i = 0; i < procs; ++i ){
+            s_lens[0][i] = workload_pair_size(i, *myindex, cb_nodes, data_size);
+            s_len += s_lens[0][i];
+        }
+        *send_buf = (char**) malloc(sizeof(char*) * procs);
+        send_buf[0][0] = comm_buf_alloc(s_len);
+        for ( i = 1; i < procs; ++i ){
+            send_buf[0][i] = send_buf[0][i-1] + s_lens[0][i-1];
+        }
+        fill_messages(rank, send_buf[0], s_lens[0], procs, iter);
     } else{
         *requests = (MPI_Request*) malloc(sizeof(MPI_Request) * cb_nodes);
         *status = (MPI_Status*) malloc(sizeof(MPI_Status) * cb_nodes);
     }
     r_len = 0;
     for ( i = 0; i < cb_nodes; ++i ){
-        r_len += (rank_list[i] % span + 1) * data_size;
-        r_lens[0][i] = (rank_list[i] % span + 1) * data_size;
+        r_lens[0][i] = workload_pair_size(rank, i, cb_nodes, data_size);
+        r_len += r_lens[0][i];
     }
 
     *recv_buf = (char**) malloc(sizeof(char*) * cb_nodes);
-    recv_buf[0][0] = (char*) malloc(sizeof(char) * r_len);
+    recv_buf[0][0] = comm_buf_alloc(r_len);
     for ( i = 1; i < cb_nodes; ++i ){
         recv_buf[0][i] = recv_buf[0][i-1] + r_lens[0][i-1];
     }
 
+    timer->setup_time = MPI_Wtime() - start;
     return 0;
 }
 
-int clean_many_to_all(int rank, int procs, int cb_nodes, int *rank_list, int myindex, int iter, char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int **r_lens, int isagg){
 /*
-    int i;
-    for ( i = 0; i < cb_nodes; ++i ){
-        if ( check_buffer(rank_list[i], recv_buf[0][i], r_lens[0][i], rank, iter) ){
-            printf("rank %d, message is wrong from rank %d\n",rank, rank_list[i]);
+ * Verify count received messages against the payload pattern and record the number of corrupted messages and bytes in timer.
+ * Message i came from source[i] (or from rank i if source is NULL) and was generated with seed.
+*/
+int verify_messages(char **recv_buf, int *r_lens, int count, int *source, int seed, int iter, Timer *timer){
+    int i, wrong;
+    timer->corrupt_messages = 0;
+    timer->corrupt_bytes = 0;
+    if (!verify){
+        return 0;
+    }
+    for ( i = 0; i < count; ++i ){
+        wrong = check_buffer(source ? source[i] : i, recv_buf[i], r_lens[i], seed, iter);
+        if (wrong){
+            timer->corrupt_messages += 1;
+            timer->corrupt_bytes += wrong;
         }
     }
-*/
-    rank = 0;
+    return 0;
+}
+
+int clean_many_to_all(int rank, int procs, int cb_nodes, int *rank_list, int myindex, int iter, char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int **s_lens, int **r_lens, int isagg, Timer *timer){
+    verify_messages(recv_buf[0], r_lens[0], cb_nodes, rank_list, rank, iter, timer);
     procs = 0;
-    cb_nodes = 0;
-    rank_list = NULL;
     myindex = 0;
-    iter = 0;
     free(r_lens[0]);
-    free(recv_buf[0][0]);
+    comm_buf_free(recv_buf[0][0]);
     free(recv_buf[0]);
     free(status[0]);
     free(requests[0]);
     if (isagg){
-        free(send_buf[0][0]);
+        free(s_lens[0]);
+        comm_buf_free(send_buf[0][0]);
         free(send_buf[0]);
     }
     return 0;
 }
 
-int prepare_all_to_many_data(char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int *myindex, int *s_len, int **r_lens, int rank, int procs, int isagg, int cb_nodes, int *rank_list, int data_size, int iter){
-    int span = 1;
-    MPI_Aint r_len;
-    *s_len = (rank % span + 1) * data_size;
-    *r_lens = (int*) malloc(sizeof(int) * procs);
+int prepare_all_to_many_data(char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int *myindex, int **s_lens, int **r_lens, int rank, int procs, int isagg, int cb_nodes, int *rank_list, int data_size, int iter, Timer *timer){
+    double start = MPI_Wtime();
+    MPI_Aint r_len, s_len;
+    *s_lens = (int*) malloc(sizeof(int) * cb_nodes);
+    *r_lens = NULL;
 
     int i;
     if (isagg){
+        for ( i = 0; i < cb_nodes; ++i ){
+            if (rank_list[i] == rank){
+                *myindex = i;
+            }
+        }
         *requests = (MPI_Request*) malloc(sizeof(MPI_Request) * (cb_nodes + procs * 2));
         *status = (MPI_Status*) malloc(sizeof(MPI_Status) * (cb_nodes + procs * 2));
+        *r_lens = (int*) malloc(sizeof(int) * procs);
         recv_buf[0] = (char**) malloc(sizeof(char*) * procs);
         r_len = 0;
         for ( i = 0; i < procs; ++i ){
-            r_lens[0][i] = (i % span + 1) * data_size;
+            r_lens[0][i] = workload_pair_size(i, *myindex, cb_nodes, data_size);
             r_len += r_lens[0][i];
         }
 
-        recv_buf[0][0] = (char*) malloc(sizeof(char) * r_len);
+        recv_buf[0][0] = comm_buf_alloc(r_len);
         for ( i = 1; i < procs; ++i ){
             recv_buf[0][i] = recv_buf[0][i-1] + r_lens[0][i-1];
         }
-        for ( i = 0; i < cb_nodes; ++i ){
-            if (rank_list[i] == rank){
-                *myindex = i;
-            }
-        }
     } else{
         *requests = (MPI_Request*) malloc(sizeof(MPI_Request) * cb_nodes);
         *status = (MPI_Status*) malloc(sizeof(MPI_Status) * cb_nodes);
     }
 
+    s_len = 0;
+    for ( i = 0; i < cb_nodes; ++i ){
+        s_lens[0][i] = workload_pair_size(rank, i, cb_nodes, data_size);
+        s_len += s_lens[0][i];
+    }
     send_buf[0] = (char**) malloc(sizeof(char*) * cb_nodes);
-    send_buf[0][0] = (char*) malloc(sizeof(char) * s_len[0] * cb_nodes);
-    fill_buffer(rank, send_buf[0][0], s_len[0], 0, iter);
+    send_buf[0][0] = comm_buf_alloc(s_len);
     for ( i = 1; i < cb_nodes; ++i ){
-        send_buf[0][i] = send_buf[0][i-1] + s_len[0];
-        fill_buffer(rank, send_buf[0][i], s_len[0], i, iter);
+        send_buf[0][i] = send_buf[0][i-1] + s_lens[0][i-1];
     }
+    fill_messages(rank, send_buf[0], s_lens[0], cb_nodes, iter);
 
+    timer->setup_time = MPI_Wtime() - start;
     return 0;
 }
 
-int clean_all_to_many(int rank, int procs, int cb_nodes, int *rank_list, int myindex, int iter, char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int **r_lens, int isagg){
 /*
-    int i = 0;
+ * Second phase of a two-phase collective write. The file is cut into stripe_size stripes that are assigned to the aggregators round-robin, the same way
+ * ROMIO's Lustre driver aligns file domains to stripes, so aggregator myindex owns stripes myindex, myindex + cb_nodes, ... and fills as many of them as
+ * its received data needs. stripe_count is passed to the file system as the striping_factor hint. All processes take part (the MPI-IO open is collective)
+ * and the time from the barrier after the exchange to the closed, synced file is recorded in io_time.
 */
-    free(send_buf[0][0]);
+int write_file_domain(int rank, int cb_nodes, int myindex, int isagg, char *buf, MPI_Aint len, Timer *timer){
+    MPI_File fh;
+    MPI_Info info;
+    MPI_Offset offset;
+    MPI_Aint pos, chunk, written = 0;
+    ssize_t done;
+    char value[32];
+    double start;
+    int fd = -1, flag;
+    static int stripe_reported = 0;
+
+    timer->io_time = 0;
+    timer->io_bytes = 0;
+    if (io_setting.method == IO_NONE){
+        return 0;
+    }
+    if (!isagg){
+        len = 0;
+    }
+    /* Drop the previous iteration's file so a shorter run leaves no stale tail and the striping hint applies on creation.*/
+    if (rank == 0){
+        if (io_setting.method == IO_MPI){
+            MPI_File_delete(io_setting.path, MPI_INFO_NULL);
+        } else {
+            fd = open(io_setting.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd >= 0){
+                close(fd);
+            }
+            fd = -1;
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    if (io_setting.method == IO_MPI){
+        MPI_Info_create(&info);
+        sprintf(value, "%d", io_setting.stripe_size);
+        MPI_Info_set(info, "striping_unit", value);
+        sprintf(value, "%d", io_setting.stripe_count);
+        MPI_Info_set(info, "striping_factor", value);
+        err = MPI_File_open(MPI_COMM_WORLD, io_setting.path, MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &fh);
+        ERR
+        MPI_Info_free(&info);
+        if (rank == 0 && !stripe_reported){
+            MPI_File_get_info(fh, &info);
+            MPI_Info_get(info, "striping_factor", sizeof(value) - 1, value, &flag);
+            printf("I/O stripe count requested = %d, applied = %s\n", io_setting.stripe_count, flag ? value : "unknown");
+            MPI_Info_free(&info);
+            stripe_reported = 1;
+        }
+    } else if (len){
+        fd = open(io_setting.path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0){
+            printf("rank %d, cannot open %s\n", rank, io_setting.path);
+        }
+    }
+    for ( pos = 0; pos < len; pos += chunk ){
+        chunk = len - pos < io_setting.stripe_size ? len - pos : io_setting.stripe_size;
+        offset = ((MPI_Offset) (pos / io_setting.stripe_size) * cb_nodes + myindex) * io_setting.stripe_size;
+        if (io_setting.method == IO_MPI){
+            err = MPI_File_write_at(fh, offset, buf + pos, (int) chunk, MPI_BYTE, MPI_STATUS_IGNORE);
+            ERR
+            if (err == MPI_SUCCESS){
+                written += chunk;
+            }
+        } else if (fd >= 0){
+            done = pwrite(fd, buf + pos, chunk, offset);
+            if (done > 0){
+                written += done;
+            }
+            if (done != chunk){
+                printf("rank %d, short write to %s at offset %lld\n", rank, io_setting.path, (long long) offset);
+            }
+        }
+    }
+    if (io_setting.method == IO_MPI){
+        MPI_File_sync(fh);
+        MPI_File_close(&fh);
+    } else if (fd >= 0){
+        fsync(fd);
+        close(fd);
+    }
+    timer->io_time = MPI_Wtime() - start;
+    /* Only the bytes that reached the file count towards the write bandwidth.*/
+    timer->io_bytes = (double) written;
+    return 0;
+}
+
+int clean_all_to_many(int rank, int procs, int cb_nodes, int *rank_list, int myindex, int iter, char ***send_buf, char*** recv_buf, MPI_Status **status, MPI_Request **requests, int **s_lens, int **r_lens, int isagg, Timer *timer){
+    int i = 0;
+    MPI_Aint r_len = 0;
+    if (isagg){
+        for ( i = 0; i < procs; ++i ){
+            r_len += r_lens[0][i];
+        }
+    }
+    write_file_domain(rank, cb_nodes, myindex, isagg, isagg ? recv_buf[0][0] : NULL, r_len, timer);
+    free(s_lens[0]);
+    comm_buf_free(send_buf[0][0]);
     free(send_buf[0]);
     free(status[0]);
     free(requests[0]);
+    timer->corrupt_messages = 0;
+    timer->corrupt_bytes = 0;
     if (isagg){
-/*
-        for ( i = 0; i < procs; ++i ){
-            if ( check_buffer(i, recv_buf[0][i], r_lens[0][i], myindex, iter) ){
-                printf("rank %d, message is wrong from rank %d\n",rank, i);
-            }
-        }
-*/
+        verify_messages(recv_buf[0], r_lens[0], procs, NULL, myindex, iter, timer);
         free(r_lens[0]);
-        free(recv_buf[0][0]);
+        comm_buf_free(recv_buf[0][0]);
         free(recv_buf[0]);
     }
     rank = 0;
@@ -230,18 +657,80 @@ int clean_all_to_many(int rank, int procs, int cb_nodes, int *rank_list, int myi
     return 0;
 }
 
-int all_to_many_alltoall_translate(int **sdispls, int **rdispls, int **sendcounts, int **recvcounts, MPI_Datatype **dtypes, int *rank_list, int isagg, int cb_nodes, int procs, int s_len, int* r_lens){
+/*
+ * MPI_Alltoallw with byte displacements of type MPI_Aint, so a process can exchange more than 2 GiB in total while every pair stays below INT_MAX.
+ * MPI-4 libraries take the displacements directly (MPI_Alltoallw_c). Otherwise int displacements are used while they fit; beyond that every pair is
+ * described by an hindexed datatype that carries its own displacement and the exchange runs with zero displacements.
+*/
+int alltoallw_aint(void *sendbuf, int *sendcounts, MPI_Aint *sdispls, MPI_Datatype *sendtypes, void *recvbuf, int *recvcounts, MPI_Aint *rdispls, MPI_Datatype *recvtypes, MPI_Comm comm){
+    int procs, i;
+    MPI_Comm_size(comm, &procs);
+#if MPI_VERSION >= 4
+    MPI_Count *scounts = (MPI_Count*) malloc(sizeof(MPI_Count) * procs * 2);
+    MPI_Count *rcounts = scounts + procs;
+    for ( i = 0; i < procs; ++i ){
+        scounts[i] = sendcounts[i];
+        rcounts[i] = recvcounts[i];
+    }
+    err = MPI_Alltoallw_c(sendbuf, scounts, sdispls, sendtypes, recvbuf, rcounts, rdispls, recvtypes, comm);
+    ERR
+    free(scounts);
+#else
+    int *s_int, *r_int, *s_ones, *r_ones, fits = 1;
+    MPI_Datatype *s_types, *r_types;
+    s_int = (int*) malloc(sizeof(int) * procs * 4);
+    r_int = s_int + procs;
+    s_ones = r_int + procs;
+    r_ones = s_ones + procs;
+    for ( i = 0; i < procs; ++i ){
+        if (sdispls[i] > INT_MAX || rdispls[i] > INT_MAX){
+            fits = 0;
+        }
+        s_int[i] = (int) sdispls[i];
+        r_int[i] = (int) rdispls[i];
+    }
+    if (fits){
+        err = MPI_Alltoallw(sendbuf, sendcounts, s_int, sendtypes, recvbuf, recvcounts, r_int, recvtypes, comm);
+        ERR
+    } else {
+        s_types = (MPI_Datatype*) malloc(sizeof(MPI_Datatype) * procs * 2);
+        r_types = s_types + procs;
+        for ( i = 0; i < procs; ++i ){
+            s_int[i] = 0;
+            r_int[i] = 0;
+            s_ones[i] = sendcounts[i] ? 1 : 0;
+            r_ones[i] = recvcounts[i] ? 1 : 0;
+            MPI_Type_create_hindexed(1, sendcounts + i, sdispls + i, sendtypes[i], s_types + i);
+            MPI_Type_commit(s_types + i);
+            MPI_Type_create_hindexed(1, recvcounts + i, rdispls + i, recvtypes[i], r_types + i);
+            MPI_Type_commit(r_types + i);
+        }
+        err = MPI_Alltoallw(sendbuf, s_ones, s_int, s_types, recvbuf, r_ones, r_int, r_types, comm);
+        ERR
+        for ( i = 0; i < procs * 2; ++i ){
+            MPI_Type_free(s_types + i);
+        }
+        free(s_types);
+    }
+    free(s_int);
+#endif
+    return 0;
+}
+
+int all_to_many_alltoall_translate(MPI_Aint **sdispls, MPI_Aint **rdispls, int **sendcounts, int **recvcounts, MPI_Datatype **dtypes, int *rank_list, int isagg, int cb_nodes, int procs, int *s_lens, int* r_lens){
     int i;
-    *sdispls = (int*) malloc(sizeof(int) * procs);
+    *sdispls = (MPI_Aint*) malloc(sizeof(MPI_Aint) * procs);
     *sendcounts = (int*) malloc(sizeof(int) * procs);
-    *rdispls = (int*) malloc(sizeof(int) * procs);
+    *rdispls = (MPI_Aint*) malloc(sizeof(MPI_Aint) * procs);
     *recvcounts = (int*) malloc(sizeof(int) * procs);
 
-    memset(*sdispls, 0, sizeof(int) * procs);
+    memset(*sdispls, 0, sizeof(MPI_Aint) * procs);
     memset(*sendcounts, 0, sizeof(int) * procs);
-    for ( i = 0; i < cb_nodes; ++i ){
-        sdispls[0][rank_list[i]] = i * s_len * sizeof(char);
-        sendcounts[0][rank_list[i]] = s_len;
+    sdispls[0][rank_list[0]] = 0;
+    sendcounts[0][rank_list[0]] = s_lens[0];
+    for ( i = 1; i < cb_nodes; ++i ){
+        sdispls[0][rank_list[i]] = sdispls[0][rank_list[i-1]] + s_lens[i-1];
+        sendcounts[0][rank_list[i]] = s_lens[i];
     }
     if (isagg) {
         recvcounts[0][0] = r_lens[0];
@@ -252,7 +741,7 @@ int all_to_many_alltoall_translate(int **sdispls, int **rdispls, int **sendcount
         }
     } else {
         memset(*recvcounts, 0, sizeof(int) * procs);
-        memset(*rdispls, 0, sizeof(int) * procs);
+        memset(*rdispls, 0, sizeof(MPI_Aint) * procs);
     }
 
     *dtypes = (MPI_Datatype*) malloc(procs * sizeof(MPI_Datatype));
@@ -261,7 +750,7 @@ int all_to_many_alltoall_translate(int **sdispls, int **rdispls, int **sendcount
     return 0;
 }
 
-int all_to_many_alltoall_clean(int *sdispls, int *rdispls, int *sendcounts, int *recvcounts, MPI_Datatype *dtypes){
+int all_to_many_alltoall_clean(MPI_Aint *sdispls, MPI_Aint *rdispls, int *sendcounts, int *recvcounts, MPI_Datatype *dtypes){
     free(dtypes);
     free(sdispls);
     free(rdispls);
@@ -270,14 +759,14 @@ int all_to_many_alltoall_clean(int *sdispls, int *rdispls, int *sendcounts, int
     return 0;
 }
 
-int many_to_all_alltoall_translate(int **sdispls, int **rdispls, int **sendcounts, int **recvcounts, MPI_Datatype **dtypes, int *rank_list, int isagg, int cb_nodes, int procs, int s_len, int* r_lens){
+int many_to_all_alltoall_translate(MPI_Aint **sdispls, MPI_Aint **rdispls, int **sendcounts, int **recvcounts, MPI_Datatype **dtypes, int *rank_list, int isagg, int cb_nodes, int procs, int *s_lens, int* r_lens){
     int i;
-    *sdispls = (int*) malloc(sizeof(int) * procs);
+    *sdispls = (MPI_Aint*) malloc(sizeof(MPI_Aint) * procs);
     *sendcounts = (int*) malloc(sizeof(int) * procs);
-    *rdispls = (int*) malloc(sizeof(int) * procs);
+    *rdispls = (MPI_Aint*) malloc(sizeof(MPI_Aint) * procs);
     *recvcounts = (int*) malloc(sizeof(int) * procs);
 
-    memset(*rdispls, 0, sizeof(int) * procs);
+    memset(*rdispls, 0, sizeof(MPI_Aint) * procs);
     memset(*recvcounts, 0, sizeof(int) * procs);
 
     rdispls[0][rank_list[0]] = 0;
@@ -287,13 +776,15 @@ int many_to_all_alltoall_translate(int **sdispls, int **rdispls, int **sendcount
         recvcounts[0][rank_list[i]] = r_lens[i];
     }
     if (isagg) {
-        for ( i = 0; i < procs; ++i ){
-            sendcounts[0][i] = s_len;
-            sdispls[0][i] = i * s_len * sizeof(char);
+        sendcounts[0][0] = s_lens[0];
+        sdispls[0][0] = 0;
+        for ( i = 1; i < procs; ++i ){
+            sendcounts[0][i] = s_lens[i];
+            sdispls[0][i] = sdispls[0][i-1] + s_lens[i-1];
         }
     } else {
         memset(*sendcounts, 0, sizeof(int) * procs);
-        memset(*sdispls, 0, sizeof(int) * procs);
+        memset(*sdispls, 0, sizeof(MPI_Aint) * procs);
     }
 
     *dtypes = (MPI_Datatype*) malloc(procs * sizeof(MPI_Datatype));
@@ -301,7 +792,7 @@ int many_to_all_alltoall_translate(int **sdispls, int **rdispls, int **sendcount
     return 0;
 }
 
-int many_to_all_alltoall_clean(int *sdispls, int *rdispls, int *sendcounts, int *recvcounts, MPI_Datatype *dtypes){
+int many_to_all_alltoall_clean(MPI_Aint *sdispls, MPI_Aint *rdispls, int *sendcounts, int *recvcounts, MPI_Datatype *dtypes){
     free(dtypes);
     free(sdispls);
     free(rdispls);
@@ -310,13 +801,25 @@ int many_to_all_alltoall_clean(int *sdispls, int *rdispls, int *sendcounts, int
     return 0;
 }
 
+/*
+ * With -N the buffers that TAM and the hierarchical methods allocate inside the exchange are written once for NUMA placement. That time is moved from the total
+ * to the setup time, so -N is compared with the default on the exchange alone.
+*/
+static int exclude_first_touch(Timer *timer){
+    timer->total_time -= comm_buf_touch_time;
+    timer->setup_time += comm_buf_touch_time;
+    comm_buf_touch_time = 0;
+    return 0;
+}
+
 int many_to_all_tam(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int procs_node, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, m, myindex = 0, s_len, *r_lens;
+    int i, m, myindex = 0, *s_lens, *r_lens;
     int *node_size, *local_ranks, *global_receivers, *process_node_list, nrecvs;
     char **send_buf, **recv_buf2;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -326,7 +829,7 @@ int many_to_all_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -338,10 +841,13 @@ int many_to_all_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
         recv_buf2[rank_list[i]] = recv_buf[i];
     }
 
-    static_node_assignment(rank, procs, 0, &procs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
+    static_node_assignment(rank, procs, tam_numa_domains ? NODE_ASSIGNMENT_NUMA : 0, &procs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
 
-    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
+    collective_write_prepare(rank, local_ranks, process_node_list, MPI_COMM_WORLD);
+
+    comm_buf_touch_time = 0;
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
 
@@ -350,6 +856,7 @@ int many_to_all_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     }
 
     timer->total_time += MPI_Wtime() - total_start;
+    exclude_first_touch(timer);
 
     free(node_size);
     free(local_ranks);
@@ -358,18 +865,19 @@ int many_to_all_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     free(recv_buf2);
     many_to_all_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int all_to_many_tam(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int procs_node, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, m, myindex = 0, s_len, *r_lens;
+    int i, m, myindex = 0, *s_lens, *r_lens;
     int *node_size, *local_ranks, *global_receivers, *process_node_list, nrecvs;
     char **send_buf, **send_buf2;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -379,7 +887,7 @@ int all_to_many_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -390,12 +898,15 @@ int all_to_many_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
         send_buf2[rank_list[i]] = send_buf[i];
     }
 
-    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
-    static_node_assignment(rank, procs, 0, &procs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
+    static_node_assignment(rank, procs, tam_numa_domains ? NODE_ASSIGNMENT_NUMA : 0, &procs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
 
     comm_size = procs;
 
+    collective_write_prepare(rank, local_ranks, process_node_list, MPI_COMM_WORLD);
+
+    comm_buf_touch_time = 0;
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
 
@@ -404,6 +915,7 @@ int all_to_many_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     }
 
     timer->total_time += MPI_Wtime() - total_start;
+    exclude_first_touch(timer);
 
     all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
@@ -413,17 +925,18 @@ int all_to_many_tam(int rank, int isagg, int procs, int cb_nodes, int data_size,
     free(process_node_list);
     free(send_buf2);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int many_to_all_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, m, myindex = 0, s_len, *r_lens, pof2, src, dst/*, src_index*/;
+    int i, m, myindex = 0, *s_lens, *r_lens, pof2, src, dst/*, src_index*/;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -433,9 +946,9 @@ int many_to_all_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
-    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     comm_size = procs;
 
@@ -502,17 +1015,18 @@ int many_to_all_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_
     timer->total_time += MPI_Wtime() - total_start;
 
     many_to_all_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int all_to_many_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, m, myindex = 0, s_len, *r_lens, pof2, src, dst/*, dst_index*/;
+    int i, m, myindex = 0, *s_lens, *r_lens, pof2, src, dst/*, dst_index*/;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -522,9 +1036,9 @@ int all_to_many_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
-    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     comm_size = procs;
 
@@ -591,17 +1105,18 @@ int all_to_many_pairwise(int rank, int isagg, int procs, int cb_nodes, int data_
 
     all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int many_to_all_benchmark(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int m, myindex = 0, s_len, *r_lens;
+    int m, myindex = 0, *s_lens, *r_lens;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -611,20 +1126,20 @@ int many_to_all_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
 
-    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
     for ( m = 0; m < ntimes; ++m){
         if (isagg){
 
-            MPI_Alltoallw(send_buf[0], sendcounts,
+            alltoallw_aint(send_buf[0], sendcounts,
                   sdispls, dtypes, recv_buf[0],
                   recvcounts, rdispls, dtypes, MPI_COMM_WORLD);
 /*
@@ -634,7 +1149,7 @@ int many_to_all_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
 */
         }else {
 
-            MPI_Alltoallw(NULL, sendcounts,
+            alltoallw_aint(NULL, sendcounts,
                   sdispls, dtypes, recv_buf[0],
                   recvcounts, rdispls, dtypes, MPI_COMM_WORLD);
 /*
@@ -648,17 +1163,18 @@ int many_to_all_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
 
     many_to_all_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int many_to_all_scattered(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, j, ii, ss, m, bblock, myindex = 0, s_len, *r_lens, dst;
+    int i, j, ii, ss, m, bblock, myindex = 0, *s_lens, *r_lens, dst;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -669,13 +1185,13 @@ int many_to_all_scattered(int rank, int isagg, int procs, int cb_nodes, int data
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
 
-    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     bblock = comm_size;
     comm_size = procs;
@@ -714,17 +1230,18 @@ int many_to_all_scattered(int rank, int isagg, int procs, int cb_nodes, int data
 
     many_to_all_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int all_to_many_scattered_isend(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int i, j, ii, ss, m, bblock, myindex = 0, s_len, *r_lens, dst;
+    int i, j, ii, ss, m, bblock, myindex = 0, *s_lens, *r_lens, dst;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -735,13 +1252,13 @@ int all_to_many_scattered_isend(int rank, int isagg, int procs, int cb_nodes, in
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
 
-    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     bblock = comm_size;
     comm_size = procs;
@@ -789,17 +1306,18 @@ int all_to_many_scattered_isend(int rank, int isagg, int procs, int cb_nodes, in
 
     all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int all_to_many_scattered(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int barrier_type, Timer *timer, Timer *timers, int iter, int ntimes){
     double total_start, total_start2;
-    int i, j, ii, ss, m, bblock, myindex = 0, s_len, *r_lens, dst;
+    int i, j, ii, ss, m, bblock, myindex = 0, *s_lens, *r_lens, dst;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -810,13 +1328,13 @@ int all_to_many_scattered(int rank, int isagg, int procs, int cb_nodes, int data
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
 
-    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     bblock = comm_size;
     comm_size = procs;
@@ -835,13 +1353,13 @@ int all_to_many_scattered(int rank, int isagg, int procs, int cb_nodes, int data
             j = 0;
             start = MPI_Wtime();
             for (i = 0; i < ss; i++) {
-                dst = (rank + i + ii) % comm_size;
+                dst = schedule_scattered_source(rank, comm_size, ii, i);
                 if (recvcounts[dst]) {
                     MPI_Irecv(recv_buf[0] + rdispls[dst], recvcounts[dst], dtypes[dst], dst, rank + dst, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             for (i = 0; i < ss; i++) {
-                dst = (rank - i - ii + comm_size) % comm_size;
+                dst = schedule_scattered_dest(rank, comm_size, ii, i);
                 if (sendcounts[dst]) {
                     MPI_Issend(send_buf[0] + sdispls[dst], sendcounts[dst], dtypes[dst], dst, rank + dst, MPI_COMM_WORLD, &requests[j++]);
                 }
@@ -876,7 +1394,7 @@ int all_to_many_scattered(int rank, int isagg, int procs, int cb_nodes, int data
     timer->total_time += MPI_Wtime() - total_start;
     all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
@@ -884,10 +1402,11 @@ int all_to_many_scattered(int rank, int isagg, int procs, int cb_nodes, int data
 
 int all_to_many_benchmark(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double total_start;
-    int m, myindex = 0, s_len, *r_lens;
+    int m, myindex = 0, *s_lens, *r_lens;
     char **send_buf;
     char **recv_buf = NULL;
-    int *sendcounts = NULL, *recvcounts = NULL, *sdispls = NULL, *rdispls = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
     MPI_Status *status;
     MPI_Request *requests;
     MPI_Datatype *dtypes;
@@ -897,19 +1416,19 @@ int all_to_many_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
 
-    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_len, r_lens);
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
 
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
     for (m = 0; m < ntimes; ++m){
         if (isagg){
-            MPI_Alltoallw(send_buf[0], sendcounts,
+            alltoallw_aint(send_buf[0], sendcounts,
                   sdispls, dtypes, recv_buf[0],
                   recvcounts, rdispls, dtypes, MPI_COMM_WORLD);
 /*
@@ -919,7 +1438,7 @@ int all_to_many_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
 */
         }else {
 
-            MPI_Alltoallw(send_buf[0], sendcounts,
+            alltoallw_aint(send_buf[0], sendcounts,
                   sdispls, dtypes, NULL,
                   recvcounts, rdispls, dtypes, MPI_COMM_WORLD);
 /*
@@ -934,14 +1453,14 @@ int all_to_many_benchmark(int rank, int isagg, int procs, int cb_nodes, int data
 
     all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 
 }
 
 int many_to_all_half_sync(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, myindex = 0, stride, s_len, *r_lens;
+    int i, j, k, x, m, temp, myindex = 0, stride, *s_lens, *r_lens;
     char **send_buf = NULL;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -951,7 +1470,7 @@ int many_to_all_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
     timer->recv_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -970,7 +1489,7 @@ int many_to_all_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
             if (isagg){
                 for ( i = 0; i < comm_size; ++i ){
                     temp = (stride * myindex + k + i) % procs;
-                    MPI_Issend(send_buf[temp], s_len, MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             timer->post_request_time += MPI_Wtime() - start;
@@ -991,14 +1510,14 @@ int many_to_all_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int all_to_many_half_sync2(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, s_len, *r_lens;
+    int i, j, k, x, m, temp, *s_lens, *r_lens;
     int myindex = 0;
     char **send_buf;
     char **recv_buf = NULL;
@@ -1009,7 +1528,7 @@ int all_to_many_half_sync2(int rank, int isagg, int procs, int cb_nodes, int dat
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > cb_nodes){
         comm_size = cb_nodes;
@@ -1026,8 +1545,8 @@ int all_to_many_half_sync2(int rank, int isagg, int procs, int cb_nodes, int dat
             j = 0;
             for ( i = 0; i < comm_size; ++i ){
                 temp = (rank + k + i)%cb_nodes;
-                MPI_Issend(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
-               //MPI_Send(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
+                MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
+               //MPI_Send(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
             }
             if (isagg){
                 for ( i = 0; i < comm_size; ++i ){
@@ -1047,14 +1566,14 @@ int all_to_many_half_sync2(int rank, int isagg, int procs, int cb_nodes, int dat
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int all_to_many_half_sync(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, s_len, *r_lens;
+    int i, j, k, x, m, temp, *s_lens, *r_lens;
     int myindex = 0;
     char **send_buf;
     char **recv_buf = NULL;
@@ -1065,7 +1584,7 @@ int all_to_many_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > cb_nodes){
         comm_size = cb_nodes;
@@ -1084,7 +1603,7 @@ int all_to_many_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
 /*
                 for ( i = 0; i < comm_size; ++i ){
                     temp = (rank + k + i)  %cb_nodes;
-                    MPI_Issend(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
                 }
 */
                 for ( i = 0; i < comm_size; ++i ){
@@ -1096,7 +1615,7 @@ int all_to_many_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
             }
             for ( i = 0; i < comm_size; ++i ){
                 temp = (rank + k + i)%cb_nodes;
-                MPI_Send(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
+                MPI_Send(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
             }
             start = MPI_Wtime();
             if (j) {
@@ -1108,35 +1627,120 @@ int all_to_many_half_sync(int rank, int isagg, int procs, int cb_nodes, int data
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int node_robin_map(int rank, int proc_node, int procs,int **node_robin_map, int *rank_index){
-    int i, j, count;
+    int i;
     *node_robin_map = (int*) malloc(sizeof(int) * procs);
-    count = 0;
-    j = 0;
+    schedule_node_robin(procs, proc_node, *node_robin_map);
     for ( i = 0; i < procs; ++i ){
-        node_robin_map[0][i] = count;
-        if ( count == rank ){
+        if ( node_robin_map[0][i] == rank ){
             *rank_index = i;
         }
-        count += proc_node;
-        if (count >= procs) {
-            j++;
-            count = j;    
-        }
     }
     return 0;
 }
 
+/*
+ * All to many through collective_write_hierarchical with the -L group sizes (default: one level of proc_node ranks, like TAM).
+*/
+int all_to_many_hierarchical(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int procs_node, Timer *timer, int iter, int ntimes){
+    double total_start;
+    int i, m, myindex = 0, *s_lens, *r_lens, nlevels, *level_sizes;
+    char **send_buf, **send_buf2;
+    char **recv_buf = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
+    MPI_Status *status;
+    MPI_Request *requests;
+    MPI_Datatype *dtypes;
+
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+
+    send_buf2 = (char**) malloc(sizeof(char*) * procs);
+    for ( i = 0; i < cb_nodes; ++i ){
+        send_buf2[rank_list[i]] = send_buf[i];
+    }
+    all_to_many_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
+    nlevels = hier_nlevels < 0 ? 1 : hier_nlevels;
+    level_sizes = hier_nlevels < 0 ? &procs_node : hier_levels;
+    (void) comm_size;
+
+    comm_buf_touch_time = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+
+    for ( m = 0; m < ntimes; ++m ){
+        collective_write_hierarchical(rank, procs, nlevels, level_sizes, sendcounts, recv_buf, send_buf2, iter, MPI_COMM_WORLD, timer);
+    }
+
+    timer->total_time += MPI_Wtime() - total_start;
+    exclude_first_touch(timer);
+
+    all_to_many_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
+    free(send_buf2);
+
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
+
+int many_to_all_hierarchical(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int procs_node, Timer *timer, int iter, int ntimes){
+    double total_start;
+    int i, m, myindex = 0, *s_lens, *r_lens, nlevels, *level_sizes;
+    char **send_buf, **recv_buf2;
+    char **recv_buf = NULL;
+    int *sendcounts = NULL, *recvcounts = NULL;
+    MPI_Aint *sdispls = NULL, *rdispls = NULL;
+    MPI_Status *status;
+    MPI_Request *requests;
+    MPI_Datatype *dtypes;
+
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+
+    recv_buf2 = (char**) malloc(sizeof(char*) * procs);
+    for ( i = 0; i < cb_nodes; ++i ){
+        recv_buf2[rank_list[i]] = recv_buf[i];
+    }
+    many_to_all_alltoall_translate(&sdispls, &rdispls, &sendcounts, &recvcounts, &dtypes, rank_list, isagg, cb_nodes, procs, s_lens, r_lens);
+    nlevels = hier_nlevels < 0 ? 1 : hier_nlevels;
+    level_sizes = hier_nlevels < 0 ? &procs_node : hier_levels;
+    (void) comm_size;
+
+    comm_buf_touch_time = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+
+    for ( m = 0; m < ntimes; ++m ){
+        collective_write_hierarchical(rank, procs, nlevels, level_sizes, sendcounts, recv_buf2, send_buf, iter, MPI_COMM_WORLD, timer);
+    }
+
+    timer->total_time += MPI_Wtime() - total_start;
+    exclude_first_touch(timer);
+
+    free(recv_buf2);
+    many_to_all_alltoall_clean(sdispls, rdispls, sendcounts, recvcounts, dtypes);
+
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
+
 int all_to_many_node_robin(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int proc_node, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, send_start, s_len, *r_lens, *rank_robin_map;
-    int myindex = 0, rank_index;
-    int ceiling, floor, remainder;
+    int i, j, k, x, m, n, temp, send_start, *s_lens, *r_lens, *rank_robin_map, *targets;
+    int myindex = 0, rank_index = 0;
     char **send_buf;
     char **recv_buf = NULL;
     int bblock;
@@ -1148,24 +1752,19 @@ int all_to_many_node_robin(int rank, int isagg, int procs, int cb_nodes, int dat
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
     node_robin_map(rank, proc_node, procs, &rank_robin_map, &rank_index);
 
     if (comm_size > procs){
         comm_size = procs;
     }
     bblock = comm_size;
+    targets = (int*) malloc(sizeof(int) * cb_nodes);
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
-    
-    ceiling = (procs + cb_nodes - 1) / cb_nodes;
-    floor = procs / cb_nodes; 
-    remainder = procs % cb_nodes;
-    if ( rank_index >= remainder * ceiling ){
-        send_start = remainder + (rank_index - remainder * ceiling) / floor;
-    } else{
-        send_start = rank_index / ceiling;
-    }
+
+    /* The balanced schedule over node-robin positions instead of ranks.*/
+    send_start = schedule_balanced_start(rank_index, procs, cb_nodes);
     for ( m = 0; m < ntimes; ++m ){
         comm_size = bblock;
         for ( k = 0; k < procs; k+=comm_size ){
@@ -1176,36 +1775,14 @@ int all_to_many_node_robin(int rank, int isagg, int procs, int cb_nodes, int dat
             start = MPI_Wtime();
             if (isagg){
                 for ( i = 0; i < comm_size; ++i ){
-                    if (myindex < remainder) {
-                        temp = (k + i + myindex * ceiling) % procs;
-                    } else {
-                        temp = (k + i + remainder * ceiling + (myindex - remainder) * floor) % procs;
-                    }
-                    temp = rank_robin_map[temp];
+                    temp = rank_robin_map[schedule_balanced_source(myindex, procs, cb_nodes, k, i)];
                     MPI_Irecv(recv_buf[temp], r_lens[temp], MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             MPI_Barrier(MPI_COMM_WORLD);
-            for ( x = 0; x < cb_nodes; ++x ) {
-                if (send_start < remainder) {
-                    temp = (k + send_start * ceiling);
-                } else {
-                    temp = (k + remainder * ceiling + (send_start - remainder) * floor);
-                }
-                if ( (temp >= procs && temp + comm_size >= procs) || (temp < procs && temp + comm_size < procs) ){
-                    if (rank_index >= temp % procs && rank_index < (temp + comm_size) % procs ) {
-                        MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);                       
-                    } else {
-                        break;
-                    }
-                } else{
-                    if ( rank_index >= temp || rank_index < (temp + comm_size) % procs ) {
-                        MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);                        
-                    } else {
-                        break;
-                    }
-                }
-                send_start = (send_start - 1 + cb_nodes) % cb_nodes;
+            n = schedule_balanced_sends(rank_index, procs, cb_nodes, k, comm_size, &send_start, targets);
+            for ( x = 0; x < n; ++x ) {
+                MPI_Issend(send_buf[targets[x]], s_lens[targets[x]], MPI_BYTE, rank_list[targets[x]], rank + rank_list[targets[x]], MPI_COMM_WORLD, &requests[j++]);
             }
             timer->post_request_time += MPI_Wtime() - start;
             if (j) {
@@ -1220,15 +1797,16 @@ int all_to_many_node_robin(int rank, int isagg, int procs, int cb_nodes, int dat
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     free(rank_robin_map);
+    free(targets);
 
     return 0;
 }
 
 int all_to_many_balanced_control(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, send_start, s_len, *r_lens;
+    int i, j, k, x, m, temp, send_start, *s_lens, *r_lens;
     int myindex = 0;
     int ceiling, floor, remainder;
     char **send_buf;
@@ -1243,7 +1821,7 @@ int all_to_many_balanced_control(int rank, int isagg, int procs, int cb_nodes, i
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -1298,7 +1876,7 @@ int all_to_many_balanced_control(int rank, int isagg, int procs, int cb_nodes, i
                             // Wait for signal to post issend, this can avoid congestion caused by Issend
                             MPI_Recv(MPI_BOTTOM, 0, MPI_BYTE, rank_list[send_start], rank * 100 + rank_list[send_start],
                                         signal_comm, MPI_STATUS_IGNORE);
-                            MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
+                            MPI_Issend(send_buf[send_start], s_lens[send_start], MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
                         }                       
                     } else {
                         break;
@@ -1309,7 +1887,7 @@ int all_to_many_balanced_control(int rank, int isagg, int procs, int cb_nodes, i
                             // Wait for signal to post issend, this can avoid congestion caused by Issend
                             MPI_Recv(MPI_BOTTOM, 0, MPI_BYTE, rank_list[send_start], rank * 100 + rank_list[send_start],
                                         signal_comm, MPI_STATUS_IGNORE);
-                            MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
+                            MPI_Issend(send_buf[send_start], s_lens[send_start], MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
                         }                        
                     } else {
                         break;
@@ -1330,14 +1908,14 @@ int all_to_many_balanced_control(int rank, int isagg, int procs, int cb_nodes, i
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int all_to_many_balanced_pre_send(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, m, x, temp, send_start, s_len, *r_lens;
+    int i, j, k, m, x, temp, send_start, *s_lens, *r_lens;
     int myindex = 0;
     int ceiling, floor, remainder;
     char **send_buf;
@@ -1351,7 +1929,7 @@ int all_to_many_balanced_pre_send(int rank, int isagg, int procs, int cb_nodes,
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -1374,7 +1952,7 @@ int all_to_many_balanced_pre_send(int rank, int isagg, int procs, int cb_nodes,
         for ( k = 0; k < cb_nodes; ++k ) {
             i = (send_start - k + cb_nodes) % cb_nodes;
             if ( rank_list[i] != rank ){
-                MPI_Issend(send_buf[i], s_len, MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
+                MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
             }
         }
         recv_requests = requests + j;
@@ -1413,7 +1991,7 @@ int all_to_many_balanced_pre_send(int rank, int isagg, int procs, int cb_nodes,
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
@@ -1421,9 +1999,8 @@ int all_to_many_balanced_pre_send(int rank, int isagg, int procs, int cb_nodes,
 
 int all_to_many_balanced(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, send_start, s_len, *r_lens;
+    int i, j, k, x, m, n, temp, send_start, *s_lens, *r_lens, *targets;
     int myindex = 0;
-    int ceiling, floor, remainder;
     char **send_buf;
     char **recv_buf = NULL;
     int bblock;
@@ -1434,23 +2011,17 @@ int all_to_many_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
     }
     bblock = comm_size;
+    targets = (int*) malloc(sizeof(int) * cb_nodes);
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
-    
-    ceiling = (procs + cb_nodes - 1) / cb_nodes;
-    floor = procs / cb_nodes;
-    remainder = procs % cb_nodes;
-    if ( rank >= remainder * ceiling ){
-        send_start = remainder + (rank - remainder * ceiling) / floor;
-    } else{
-        send_start = rank / ceiling;
-    }
+
+    send_start = schedule_balanced_start(rank, procs, cb_nodes);
     for ( m = 0; m < ntimes; ++m ){
         comm_size = bblock;
         for ( k = 0; k < procs; k+=comm_size ){
@@ -1460,11 +2031,7 @@ int all_to_many_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
             j = 0;
             if (isagg){
                 for ( i = 0; i < comm_size; ++i ){
-                    if (myindex < remainder) {
-                        temp = (k + i + myindex * ceiling) % procs;
-                    } else {
-                        temp = (k + i + remainder * ceiling + (myindex - remainder) * floor) % procs;
-                    }
+                    temp = schedule_balanced_source(myindex, procs, cb_nodes, k, i);
                     if (temp != rank){
                         start = MPI_Wtime();
                         MPI_Irecv(recv_buf[temp], r_lens[temp], MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
@@ -1474,30 +2041,11 @@ int all_to_many_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
                     }
                 }
             }
-            for ( x = 0; x < cb_nodes; ++x ) {
-                if (send_start < remainder) {
-                    temp = k + send_start * ceiling;
-                } else {
-                    temp = k + remainder * ceiling + (send_start - remainder) * floor;
-                }
-                if ( (temp >= procs && temp + comm_size >= procs) || (temp < procs && temp + comm_size < procs) ){
-                    if (rank >= temp % procs && rank < (temp + comm_size) % procs ) {
-                        if ( rank_list[send_start] != rank ){
-                            MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
-                        }                       
-                    } else {
-                        break;
-                    }
-                } else{
-                    if ( rank >= temp || rank < (temp + comm_size) % procs ) {
-                        if ( rank_list[send_start] != rank ){
-                            MPI_Issend(send_buf[send_start], s_len, MPI_BYTE, rank_list[send_start], rank + rank_list[send_start], MPI_COMM_WORLD, &requests[j++]);
-                        }                        
-                    } else {
-                        break;
-                    }
+            n = schedule_balanced_sends(rank, procs, cb_nodes, k, comm_size, &send_start, targets);
+            for ( x = 0; x < n; ++x ) {
+                if ( rank_list[targets[x]] != rank ){
+                    MPI_Issend(send_buf[targets[x]], s_lens[targets[x]], MPI_BYTE, rank_list[targets[x]], rank + rank_list[targets[x]], MPI_COMM_WORLD, &requests[j++]);
                 }
-                send_start = (send_start - 1 + cb_nodes) % cb_nodes;
             }
             if (j) {
                 start = MPI_Wtime();
@@ -1510,15 +2058,16 @@ int all_to_many_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
         }
     }
     timer->total_time += MPI_Wtime() - total_start;
+    free(targets);
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int many_to_all_balanced_boundary(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, myindex = 0, stride, s_len, *r_lens;
+    int i, j, k, x, m, temp, myindex = 0, stride, *s_lens, *r_lens;
     char **send_buf = NULL;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -1528,7 +2077,7 @@ int many_to_all_balanced_boundary(int rank, int isagg, int procs, int cb_nodes,
     timer->recv_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -1554,7 +2103,7 @@ int many_to_all_balanced_boundary(int rank, int isagg, int procs, int cb_nodes,
             if (isagg){
                 for ( i = 0; i < comm_size; ++i ){
                     temp = (stride * myindex + k + i) % procs;
-                    MPI_Issend(send_buf[temp], s_len, MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             timer->post_request_time += MPI_Wtime() - start;
@@ -1568,14 +2117,14 @@ int many_to_all_balanced_boundary(int rank, int isagg, int procs, int cb_nodes,
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int many_to_all_balanced(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, remainder, ceiling, floor, send_start, myindex = 0, s_len, *r_lens;
+    int i, j, k, x, m, temp, remainder, ceiling, floor, send_start, myindex = 0, *s_lens, *r_lens;
     char **send_buf = NULL;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -1585,7 +2134,7 @@ int many_to_all_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
     timer->recv_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > procs){
         comm_size = procs;
@@ -1641,7 +2190,7 @@ int many_to_all_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
                         temp = (k + i + remainder * ceiling + (myindex - remainder) * floor) % procs;
                     }
                     if (temp != rank){
-                        MPI_Issend(send_buf[temp], s_len, MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
+                        MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, temp, rank + temp, MPI_COMM_WORLD, &requests[j++]);
                     } else {
                         memcpy(recv_buf[myindex], send_buf[temp], r_lens[myindex] * sizeof(char));
                     }
@@ -1657,14 +2206,14 @@ int many_to_all_balanced(int rank, int isagg, int procs, int cb_nodes, int data_
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, temp, temp2, s_len, *r_lens;
+    int i, j, k, x, m, temp, temp2, *s_lens, *r_lens;
     int myindex = 0;
     char **send_buf;
     char **recv_buf = NULL;
@@ -1675,7 +2224,7 @@ int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     if (comm_size > cb_nodes){
         comm_size = cb_nodes;
@@ -1695,7 +2244,7 @@ int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size
 /*
                 for ( i = 0; i < comm_size; ++i ){
                     temp = (rank + k + i)  % cb_nodes;
-                    MPI_Issend(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD, &requests[j++]);
                 }
 */
                 for ( i = 0; i < comm_size; ++i ){
@@ -1704,21 +2253,21 @@ int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size
                     //printf("rank %d sendrecv (%d, %d)\n", rank, rank_list[temp],temp2);
                     if ( rank_list[temp] != rank && temp2 != rank ){
                         MPI_Sendrecv( send_buf[temp],
-                                  s_len, MPI_BYTE, rank_list[temp],
+                                  s_lens[temp], MPI_BYTE, rank_list[temp],
                                   rank + rank_list[temp],
                                   recv_buf[temp2],
                                   r_lens[temp2], MPI_BYTE, temp2,
                                   rank + temp2, MPI_COMM_WORLD, status);
                     } else if ( rank_list[temp] == rank ){
                         // send to local memory directly
-                        memcpy(recv_buf[rank], send_buf[temp], sizeof(char) * s_len);
+                        memcpy(recv_buf[rank], send_buf[temp], sizeof(char) * s_lens[temp]);
                         // Only recv if it is not from the same rank
                         if ( temp2!= rank ){
                             MPI_Recv(recv_buf[temp2], r_lens[temp2], MPI_BYTE, temp2, rank + temp2, MPI_COMM_WORLD, status);
                         }
                     } else if ( temp2 == rank ){
                         // rank_list[temp] has to be != rank, memory copy done at send brank, nothing has to be done for recv
-                        MPI_Send(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
+                        MPI_Send(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
                     }
                     for ( x = temp2 + cb_nodes; x < procs; x+=cb_nodes ){
                         //printf("rank %d recv (%d)\n", rank, x);
@@ -1731,7 +2280,7 @@ int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size
                 for ( i = 0; i < comm_size; ++i ){
                     temp = (rank + k + i)%cb_nodes;
                     //printf("rank %d send to (%d)\n",rank, rank_list[temp]);
-                     MPI_Send(send_buf[temp], s_len, MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
+                     MPI_Send(send_buf[temp], s_lens[temp], MPI_BYTE, rank_list[temp], rank + rank_list[temp], MPI_COMM_WORLD);
                 }
             }
             timer->recv_wait_all_time += MPI_Wtime() - start;
@@ -1740,14 +2289,14 @@ int all_to_many_sync(int rank, int isagg, int procs, int cb_nodes, int data_size
     //printf("rank %d got here\n",rank);
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int all_to_many(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x, m, steps, myindex, s_len, *r_lens;
+    int i, j, k, x, m, steps, myindex, *s_lens, *r_lens;
     char **send_buf;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -1757,7 +2306,7 @@ int all_to_many(int rank, int isagg, int procs, int cb_nodes, int data_size, int
     timer->send_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
@@ -1773,7 +2322,7 @@ int all_to_many(int rank, int isagg, int procs, int cb_nodes, int data_size, int
                 }
             }
             for ( i = 0; i < cb_nodes; ++i ){
-                MPI_Issend(send_buf[i], s_len, MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
+                MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
             }
             timer->post_request_time += MPI_Wtime() - start;
             if (j) {
@@ -1787,7 +2336,7 @@ int all_to_many(int rank, int isagg, int procs, int cb_nodes, int data_size, int
             j=0;
             start = MPI_Wtime();
             for ( i = 0; i < cb_nodes; ++i ){
-                MPI_Issend(send_buf[i], s_len, MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
+                MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
             }
             timer->post_request_time += MPI_Wtime() - start;
             // We chop down the number of communications such that one waitall does not trigger more concurrent communication than comm_size.
@@ -1818,14 +2367,14 @@ int all_to_many(int rank, int isagg, int procs, int cb_nodes, int data_size, int
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int many_to_all_interleaved(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, m, myindex, s_len, *r_lens;
+    int i, j, m, myindex, *s_lens, *r_lens;
     char **send_buf = NULL;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -1835,7 +2384,7 @@ int many_to_all_interleaved(int rank, int isagg, int procs, int cb_nodes, int da
     timer->recv_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
@@ -1849,7 +2398,7 @@ int many_to_all_interleaved(int rank, int isagg, int procs, int cb_nodes, int da
             }
             if (isagg){
                 for ( i = 0; i < procs; ++i ){
-                    MPI_Issend(send_buf[i], s_len, MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             timer->post_request_time += MPI_Wtime() - start;
@@ -1863,14 +2412,14 @@ int many_to_all_interleaved(int rank, int isagg, int procs, int cb_nodes, int da
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
 int many_to_all(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, Timer *timer, int iter, int ntimes){
     double start, total_start;
-    int i, j, k, x,m, steps, myindex, s_len, *r_lens;
+    int i, j, k, x,m, steps, myindex, *s_lens, *r_lens;
     char **send_buf = NULL;
     char **recv_buf = NULL;
     MPI_Status *status;
@@ -1880,7 +2429,7 @@ int many_to_all(int rank, int isagg, int procs, int cb_nodes, int data_size, int
     timer->recv_wait_all_time = 0;
     timer->total_time = 0;
 
-    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_len, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter);
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
 
     MPI_Barrier(MPI_COMM_WORLD);
     total_start = MPI_Wtime();
@@ -1895,7 +2444,7 @@ int many_to_all(int rank, int isagg, int procs, int cb_nodes, int data_size, int
             }
             if (isagg){
                 for ( i = 0; i < procs; ++i ){
-                    MPI_Issend(send_buf[i], s_len, MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
+                    MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
                 }
             }
             timer->post_request_time += MPI_Wtime() - start;
@@ -1922,7 +2471,7 @@ int many_to_all(int rank, int isagg, int procs, int cb_nodes, int data_size, int
                     start = MPI_Wtime();
                     for ( i = k; i < procs; i+=steps ){
                         //MPI_Issend(send_buf[i], data_size, MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j + x]);
-                        MPI_Issend(send_buf[i], s_len, MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[cb_nodes + x]);
+                        MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[cb_nodes + x]);
                         x++;
                     }
                     timer->post_request_time += MPI_Wtime() - start;
@@ -1944,404 +2493,1792 @@ int many_to_all(int rank, int isagg, int procs, int cb_nodes, int data_size, int
     }
     timer->total_time += MPI_Wtime() - total_start;
 
-    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &r_lens, isagg);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
 
     return 0;
 }
 
-int create_aggregator_list(int rank, int procs, int cb_nodes, int proc_node, int type, int **rank_list, int *is_agg){
-    int *rank_list_ptr = (int*) malloc(sizeof(int)*cb_nodes);
-    int i, remainder, ceiling, floor;
-    *is_agg = 0;
-    if (type == 1) {
-        remainder = procs / cb_nodes;
-        ceiling = (procs + cb_nodes - 1) / cb_nodes;
-        floor = procs / cb_nodes;
-        for ( i = 0; i < cb_nodes; ++i ){
-            if ( i < remainder ){
-                rank_list_ptr[i] = ceiling * i;
-            } else {
-                rank_list_ptr[i] = ceiling * remainder + floor * (i - remainder);
+/*
+ * Hybrid variants of all_to_many and many_to_all for MPI_THREAD_MULTIPLE. Every rank runs nthreads OpenMP threads. Thread t owns the aggregators
+ * k with k % nthreads == t (and, at an aggregator, the processes i with i % nthreads == t), posts their requests and completes them on its own.
+ * The post and wait times are the maximum over the threads. comm_size is not applied, every thread posts its whole slice at once.
+*/
+int all_to_many_threaded(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int nthreads, Timer *timer, int iter, int ntimes){
+    double total_start, *post_times, *wait_times;
+    int m, t, myindex, *s_lens, *r_lens;
+    char **send_buf;
+    char **recv_buf = NULL;
+    MPI_Status *status;
+    MPI_Request *requests;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+    post_times = (double*) malloc(sizeof(double) * nthreads * 2);
+    wait_times = post_times + nthreads;
+    (void) comm_size;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        #pragma omp parallel num_threads(nthreads)
+        {
+            int i, j = 0, tid = omp_get_thread_num();
+            double start;
+            MPI_Request *thread_requests = (MPI_Request*) malloc(sizeof(MPI_Request) * ((isagg ? procs : 0) / nthreads + cb_nodes / nthreads + 2));
+            start = MPI_Wtime();
+            if (isagg) {
+                for ( i = tid; i < procs; i += nthreads ){
+                    MPI_Irecv(recv_buf[i], r_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &thread_requests[j++]);
+                }
             }
-            if (rank_list_ptr[i] == rank){
-                *is_agg = 1;
+            for ( i = tid; i < cb_nodes; i += nthreads ){
+                MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &thread_requests[j++]);
             }
+            post_times[tid] = MPI_Wtime() - start;
+            start = MPI_Wtime();
+            if (j) {
+                MPI_Waitall(j, thread_requests, MPI_STATUSES_IGNORE);
+            }
+            wait_times[tid] = MPI_Wtime() - start;
+            free(thread_requests);
         }
-    } else if (type == 0){
-        for ( i = 0; i < cb_nodes; ++i ){
-            rank_list_ptr[i] = i;
-            if (rank_list_ptr[i] == rank){
-                *is_agg = 1;
+        for ( t = 1; t < nthreads; ++t ){
+            if (post_times[t] > post_times[0]){
+                post_times[0] = post_times[t];
+            }
+            if (wait_times[t] > wait_times[0]){
+                wait_times[0] = wait_times[t];
             }
         }
-    } else if (type == 2){
-        remainder = procs / cb_nodes;
-        ceiling = (procs + cb_nodes - 1) / cb_nodes;
-        floor = procs / cb_nodes;
-        for ( i = 0; i < cb_nodes; ++i ){
-            if ( i < remainder ){
-                rank_list_ptr[i] = (ceiling * i - 16 + procs * 16 ) % procs;
-            } else {
-                rank_list_ptr[i] = (ceiling * remainder + floor * (i - remainder) - 16 + procs * 16) % procs;
+        timer->post_request_time += post_times[0];
+        timer->recv_wait_all_time += wait_times[0];
+    }
+    timer->total_time += MPI_Wtime() - total_start;
+
+    free(post_times);
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
+
+int many_to_all_threaded(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int nthreads, Timer *timer, int iter, int ntimes){
+    double total_start, *post_times, *wait_times;
+    int m, t, myindex, *s_lens, *r_lens;
+    char **send_buf = NULL;
+    char **recv_buf = NULL;
+    MPI_Status *status;
+    MPI_Request *requests;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+    post_times = (double*) malloc(sizeof(double) * nthreads * 2);
+    wait_times = post_times + nthreads;
+    (void) comm_size;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        #pragma omp parallel num_threads(nthreads)
+        {
+            int i, j = 0, tid = omp_get_thread_num();
+            double start;
+            MPI_Request *thread_requests = (MPI_Request*) malloc(sizeof(MPI_Request) * ((isagg ? procs : 0) / nthreads + cb_nodes / nthreads + 2));
+            start = MPI_Wtime();
+            for ( i = tid; i < cb_nodes; i += nthreads ){
+                MPI_Irecv(recv_buf[i], r_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &thread_requests[j++]);
+            }
+            if (isagg) {
+                for ( i = tid; i < procs; i += nthreads ){
+                    MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &thread_requests[j++]);
+                }
             }
-            if (rank_list_ptr[i] == rank){
-                *is_agg = 1;
+            post_times[tid] = MPI_Wtime() - start;
+            start = MPI_Wtime();
+            if (j) {
+                MPI_Waitall(j, thread_requests, MPI_STATUSES_IGNORE);
             }
+            wait_times[tid] = MPI_Wtime() - start;
+            free(thread_requests);
         }
-    } else if (type == 3) {
-        remainder = 0;
-        for ( i = 0; i < cb_nodes; ++i ) {
-            rank_list_ptr[i] = remainder;
-            remainder += proc_node;
-            if ( remainder >= procs ){
-                remainder = remainder % proc_node + 1;
+        for ( t = 1; t < nthreads; ++t ){
+            if (post_times[t] > post_times[0]){
+                post_times[0] = post_times[t];
             }
-            if (rank_list_ptr[i] == rank){
-                *is_agg = 1;
+            if (wait_times[t] > wait_times[0]){
+                wait_times[0] = wait_times[t];
             }
         }
+        timer->post_request_time += post_times[0];
+        timer->recv_wait_all_time += wait_times[0];
     }
-    *rank_list = rank_list_ptr;
+    timer->total_time += MPI_Wtime() - total_start;
+
+    free(post_times);
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
     return 0;
 }
 
-int save_all_timing(int rank, int procs, int ntimes, int comm_size, Timer *timers, char *prefix) {
-    FILE* stream;
-    Timer *all_timers;
-    int i ,j;
-    char filename[200];
-    if (rank == 0) {
-        all_timers = (Timer*)malloc(sizeof(Timer)*ntimes*procs);
-    } else {
-        all_timers = NULL;
+/*
+ * Progress thread: a helper thread per rank that keeps calling into MPI while the main thread computes, so that rendezvous
+ * transfers of the in-flight requests of any method advance. It polls MPI_Iprobe, which drives the progress engine, and MPI_Test
+ * on a private stop request. The sleep between polls doubles from PROGRESS_MIN_BACKOFF up to PROGRESS_MAX_BACKOFF nanoseconds and
+ * is reset whenever a message is pending. Requires MPI_THREAD_MULTIPLE.
+*/
+static pthread_t progress_tid;
+static MPI_Comm progress_comm = MPI_COMM_NULL;
+static MPI_Request progress_req;
+static int progress_running = 0;
+
+static void *progress_loop(void *arg){
+    struct timespec delay;
+    long backoff = PROGRESS_MIN_BACKOFF;
+    int flag = 0, pending;
+    while (1){
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &pending, MPI_STATUS_IGNORE);
+        MPI_Test(&progress_req, &flag, MPI_STATUS_IGNORE);
+        if (flag){
+            break;
+        }
+        if (pending){
+            backoff = PROGRESS_MIN_BACKOFF;
+        }
+        delay.tv_sec = 0;
+        delay.tv_nsec = backoff;
+        nanosleep(&delay, NULL);
+        if (backoff < PROGRESS_MAX_BACKOFF){
+            backoff *= 2;
+        }
     }
-    MPI_Gather(timers, sizeof(Timer)*ntimes, MPI_BYTE,
-                   all_timers, sizeof(Timer)*ntimes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    return arg;
+}
 
-    if (rank!=0) {
+int progress_start(){
+    if (progress_running){
         return 0;
     }
-    sprintf(filename,"%ssend_wait_all_times_%d.csv",prefix,comm_size);
-    stream = fopen(filename,"w");
-    for ( i = 0; i < procs; ++i ){
-        fprintf(stream, "%d",i);
-        for ( j = 0; j < ntimes; ++j ) {
-            fprintf(stream, ",%lf", all_timers[i*ntimes+j].send_wait_all_time);
-        }
-        fprintf(stream, "\n");
-    }
-    fclose(stream);
-    sprintf(filename,"%stotal_times_%d.csv",prefix,comm_size);
-    stream = fopen(filename,"w");
-    for ( i = 0; i < procs; ++i ){
-        fprintf(stream, "%d",i);
-        for ( j = 0; j < ntimes; ++j ) {
-            fprintf(stream, ",%lf", all_timers[i*ntimes+j].total_time);
-        }
-        fprintf(stream, "\n");
-    }
-    fclose(stream);
-    sprintf(filename,"%spost_request_time_%d.csv",prefix,comm_size);
-    stream = fopen(filename,"w");
-    for ( i = 0; i < procs; ++i ){
-        fprintf(stream, "%d",i);
-        for ( j = 0; j < ntimes; ++j ) {
-            fprintf(stream, ",%lf", all_timers[i*ntimes+j].post_request_time);
-        }
-        fprintf(stream, "\n");
+    if (progress_comm == MPI_COMM_NULL){
+        MPI_Comm_dup(MPI_COMM_SELF, &progress_comm);
     }
-    fclose(stream);
-    sprintf(filename,"%sbarrier_time_%d.csv",prefix,comm_size);
-    stream = fopen(filename,"w");
-    for ( i = 0; i < procs; ++i ){
-        fprintf(stream, "%d",i);
-        for ( j = 0; j < ntimes; ++j ) {
-            fprintf(stream, ",%lf", all_timers[i*ntimes+j].barrier_time);
-        }
-        fprintf(stream, "\n");
+    MPI_Irecv(NULL, 0, MPI_BYTE, 0, 0, progress_comm, &progress_req);
+    if (pthread_create(&progress_tid, NULL, progress_loop, NULL)){
+        MPI_Cancel(&progress_req);
+        MPI_Wait(&progress_req, MPI_STATUS_IGNORE);
+        printf("failed to create the progress thread\n");
+        return 1;
     }
-    fclose(stream);
-    free(all_timers);
+    progress_running = 1;
     return 0;
 }
 
-int summarize_results(int procs, int cb_nodes, int data_size, int comm_size, int ntimes, int type, char* filename, char* prefix, Timer timer1,Timer max_timer1) {
-    FILE* stream;
-    printf("| --------------------------------------\n");
-    printf("| %s rank 0 request post time = %lf\n", prefix, timer1.post_request_time);
-    printf("| %s rank 0 send waitall time = %lf\n", prefix, timer1.send_wait_all_time);
-    printf("| %s rank 0 recv waitall time = %lf\n", prefix, timer1.recv_wait_all_time);
-    printf("| %s rank 0 total time = %lf\n", prefix, timer1.total_time);
-    printf("| %s max request post time = %lf\n", prefix, max_timer1.post_request_time);
-    printf("| %s max send waitall time = %lf\n", prefix, max_timer1.send_wait_all_time);
-    printf("| %s max recv waitall time = %lf\n", prefix, max_timer1.recv_wait_all_time);
-    printf("| %s max total time = %lf\n", prefix, max_timer1.total_time);
-    stream = fopen(filename,"r");
-    if (stream){
-        fclose(stream);
-        stream = fopen(filename,"a");
-    } else {
-        stream = fopen(filename,"w");
-        fprintf(stream,"Method,");
-        fprintf(stream,"# of processes,");
-        fprintf(stream,"# of aggregators,");
-        fprintf(stream,"data size,");
-        fprintf(stream,"max comm,");
-        fprintf(stream,"ntimes,");
-        fprintf(stream,"aggregator type,");
-        fprintf(stream,"rank 0 post_request_time,");
-        fprintf(stream,"rank 0 send waitall time,");
-        fprintf(stream,"rank 0 recv waitall time,");
-        fprintf(stream,"rank 0 total time,");
-        fprintf(stream,"max post_request_time,");
-        fprintf(stream,"max send waitall time,");
-        fprintf(stream,"max recv waitall time,");
-        fprintf(stream,"max total time\n");
+int progress_stop(){
+    if (!progress_running){
+        return 0;
     }
-    fprintf(stream,"%s,",prefix);
-    fprintf(stream,"%d,",procs);
-    fprintf(stream,"%d,",cb_nodes);
-    fprintf(stream,"%d,",data_size);
-    fprintf(stream,"%d,",comm_size);
-    fprintf(stream,"%d,",ntimes);
-    fprintf(stream,"%d,",type);
-    fprintf(stream,"%lf,",timer1.post_request_time);
-    fprintf(stream,"%lf,",timer1.send_wait_all_time);
-    fprintf(stream,"%lf,",timer1.recv_wait_all_time);
-    fprintf(stream,"%lf,",timer1.total_time);
-    fprintf(stream,"%lf,",max_timer1.post_request_time);
-    fprintf(stream,"%lf,",max_timer1.send_wait_all_time);
-    fprintf(stream,"%lf,",max_timer1.recv_wait_all_time);
-    fprintf(stream,"%lf\n",max_timer1.total_time);
-    fclose(stream);
+    MPI_Send(NULL, 0, MPI_BYTE, 0, 0, progress_comm);
+    pthread_join(progress_tid, NULL);
+    progress_running = 0;
     return 0;
 }
 
-int main(int argc, char **argv){
-    int rank, procs, cb_nodes = 1, method = 0, data_size = 0, proc_node = 1, isagg, i, comm_size = 200000000, iter = 1, ntimes = 1, aggregator_type = 1, barrier_type = 0;
-    int *rank_list;
-    char prefix[200];
-    prefix[0] = '\0';
-    Timer timer1,max_timer1;
+/*
+ * Compute kernel of the overlap benchmark, a dependent floating-point chain that makes no MPI calls.
+*/
+static double overlap_sink = 0;
 
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD,&rank);
-    MPI_Comm_size(MPI_COMM_WORLD,&procs);
-    while ((i = getopt(argc, argv, "hp:c:m:d:a:i:k:t:r:b:")) != EOF){
-        switch(i) {
-            case 'm': 
-                method = atoi(optarg);
-                break;
-            case 'a': 
-                cb_nodes = atoi(optarg);
-                break;
-            case 'd': 
-                data_size = atoi(optarg);
-                break;
-            case 'c': 
-                comm_size = atoi(optarg);
-                break;
-            case 'i': 
-                iter = atoi(optarg);
-                break;
-            case 'p': 
-                proc_node = atoi(optarg);
-                break;
-            case 'k':
-                ntimes = atoi(optarg);
-                break;
-            case 't':
-                aggregator_type = atoi(optarg);
-                break;
-            case 'r':
-                strcpy(prefix, optarg);
-                break;
-            case 'b':
-                barrier_type = atoi(optarg);
-                break;
-            default:
-                if (rank==0) usage(argv[0]);
-                MPI_Finalize();
-      	        return 0;
-        }
+static void overlap_compute(long n){
+    double x = 1.0;
+    long i;
+    for ( i = 0; i < n; ++i ){
+        x = x * 1.0000001 + 1e-9;
     }
-    create_aggregator_list(rank, procs, cb_nodes, proc_node, aggregator_type, &rank_list, &isagg);
-
-    if (rank == 0){
-        printf("total number of processes = %d, cb_nodes = %d, proc_node = %d, data size = %d, comm_size = %d, ntimes=%d\n", procs, cb_nodes, proc_node, data_size, comm_size, ntimes);
+    overlap_sink += x;
+}
 
-        printf("aggregators = ");
-        for ( i = 0; i < cb_nodes; ++i ){
-            printf("%d, ",rank_list[i]);
+/*
+ * Number of kernel iterations that take about seconds on this process.
+*/
+static long overlap_calibrate(double seconds){
+    double start, elapsed;
+    long n = 1024;
+    while (1){
+        start = MPI_Wtime();
+        overlap_compute(n);
+        elapsed = MPI_Wtime() - start;
+        if (elapsed >= 0.01 || n > LONG_MAX / 4){
+            break;
         }
-        printf("\n");
-
+        n *= 2;
     }
+    return (long) (seconds / elapsed * n);
+}
 
-    for ( i = 0; i < iter; ++i ){
-        if (method == 0 || method == 1){
-            all_to_many(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many", timer1, max_timer1);
-            }
-        }
-        if (method == 0 || method == 2){
-            many_to_all(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all", timer1, max_timer1);
+/*
+ * Overlap benchmark on the all-to-many exchange. The exchange alone (comm_time) and the kernel alone (compute_time) are timed first,
+ * the kernel being sized to the slowest exchange. Then every experiment posts the exchange, runs the kernel and waits (total_time).
+ * Every process computes (comm_time + compute_time - total_time) / min(comm_time, compute_time), the maximum, minimum and mean are reported.
+*/
+int all_to_many_overlap(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int progress, Timer *timer, int iter, int ntimes){
+    double start, total_start, comm_time, shorter;
+    int i, j, m, myindex, *s_lens, *r_lens;
+    long n;
+    char **send_buf;
+    char **recv_buf = NULL;
+    MPI_Status *status;
+    MPI_Request *requests;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+    timer->comm_time = 0;
+    timer->compute_time = 0;
+
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+    (void) comm_size;
+
+    /* Exchange alone, without the progress thread.*/
+    MPI_Barrier(MPI_COMM_WORLD);
+    for (m = 0; m < ntimes; ++m){
+        start = MPI_Wtime();
+        j = 0;
+        if (isagg) {
+            for ( i = 0; i < procs; ++i ){
+                MPI_Irecv(recv_buf[i], r_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
             }
         }
-        if (method == 0 || method == 3){
-            all_to_many_balanced(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced", timer1, max_timer1);
-            }
+        for ( i = 0; i < cb_nodes; ++i ){
+            MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
         }
-        if (method == 0 || method == 4){
-            many_to_all_balanced(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all balanced", timer1, max_timer1);
-            }
+        if (j) {
+            MPI_Waitall(j, requests, status);
         }
+        timer->comm_time += MPI_Wtime() - start;
+    }
+    comm_time = timer->comm_time / ntimes;
+    MPI_Allreduce(MPI_IN_PLACE, &comm_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
 
-        if (method == 0 || method == 5){
-            many_to_all_benchmark(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all benchmark", timer1, max_timer1);
-            }
-        }
+    /* Kernel alone.*/
+    n = overlap_calibrate(comm_time);
+    for (m = 0; m < ntimes; ++m){
+        start = MPI_Wtime();
+        overlap_compute(n);
+        timer->compute_time += MPI_Wtime() - start;
+    }
 
-        if (method == 0 || method == 6){
-            all_to_many_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many sync", timer1, max_timer1);
+    if (progress){
+        progress_start();
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        start = MPI_Wtime();
+        j = 0;
+        if (isagg) {
+            for ( i = 0; i < procs; ++i ){
+                MPI_Irecv(recv_buf[i], r_lens[i], MPI_BYTE, i, rank + i, MPI_COMM_WORLD, &requests[j++]);
             }
         }
-
-        if (method == 0 || method == 7){
-            all_to_many_half_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many half sync", timer1, max_timer1);
-            }
+        for ( i = 0; i < cb_nodes; ++i ){
+            MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], rank + rank_list[i], MPI_COMM_WORLD, &requests[j++]);
+        }
+        timer->post_request_time += MPI_Wtime() - start;
+        overlap_compute(n);
+        if (j) {
+            start = MPI_Wtime();
+            MPI_Waitall(j, requests, status);
+            timer->recv_wait_all_time += MPI_Wtime() - start;
         }
+    }
+    timer->total_time += MPI_Wtime() - total_start;
+    if (progress){
+        progress_stop();
+    }
+    /* Overlap is computed from the times of this process, then reduced, so it never mixes maxima reached on different processes.*/
+    shorter = timer->comm_time < timer->compute_time ? timer->comm_time : timer->compute_time;
+    timer->overlap = shorter > 0 ? (timer->comm_time + timer->compute_time - timer->total_time) / shorter : 0;
+    MPI_Allreduce(&(timer->overlap), &(timer->overlap_min), 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&(timer->overlap), &(timer->overlap_mean), 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    timer->overlap_mean /= procs;
+
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
 
-        if (method == 0 || method == 8){
-            all_to_many_benchmark(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many benchmark", timer1, max_timer1);
+/*
+ * Communicator allocator of the pipelined methods. Iteration m matches on match_comms[m % depth] with tag 0, and a slot is only reused after the
+ * iteration that used it before has completed. Since a pair exchanges one message per iteration, every (iteration in flight, pair) is unique
+ * without encoding anything in the tag.
+*/
+static MPI_Comm *match_comms = NULL;
+static int match_depth = 0;
+
+int match_init(int depth){
+    int i;
+    match_depth = depth;
+    match_comms = (MPI_Comm*) malloc(sizeof(MPI_Comm) * depth);
+    for ( i = 0; i < depth; ++i ){
+        MPI_Comm_dup(MPI_COMM_WORLD, match_comms + i);
+    }
+    return 0;
+}
+
+MPI_Comm match_comm(int m){
+    return match_comms[m % match_depth];
+}
+
+int match_free(){
+    int i;
+    for ( i = 0; i < match_depth; ++i ){
+        MPI_Comm_free(match_comms + i);
+    }
+    free(match_comms);
+    match_comms = NULL;
+    match_depth = 0;
+    return 0;
+}
+
+/*
+ * Receive buffers for depth iterations in flight. Slot 0 is the buffer of recv_buf, the other depth - 1 slots are copies of its layout (count messages).
+*/
+static char **pipeline_slots(char **recv_buf, int *r_lens, int count, int depth){
+    char **slots = (char**) malloc(sizeof(char*) * depth);
+    MPI_Aint len = 0;
+    int i;
+    for ( i = 0; i < count; ++i ){
+        len += r_lens[i];
+    }
+    slots[0] = count ? recv_buf[0] : NULL;
+    for ( i = 1; i < depth; ++i ){
+        slots[i] = comm_buf_alloc(len);
+    }
+    return slots;
+}
+
+static int pipeline_slots_free(char **slots, int depth){
+    int i;
+    for ( i = 1; i < depth; ++i ){
+        comm_buf_free(slots[i]);
+    }
+    free(slots);
+    return 0;
+}
+
+/*
+ * All to many with up to depth repetitions in flight. Repetition m posts its requests on communicator slot m % depth and only waits for repetition
+ * m - depth, the previous user of that slot, before posting. Receives of every slot go to their own buffer. total_time measures throughput rather
+ * than the latency of a single exchange.
+*/
+int all_to_many_pipelined(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int depth, Timer *timer, int iter, int ntimes){
+    double start, total_start;
+    int i, j, d, m, stride, myindex, *s_lens, *r_lens, *counts;
+    char **send_buf, **slots;
+    char **recv_buf = NULL;
+    MPI_Status *status;
+    MPI_Request *requests, *pipe_requests;
+    MPI_Comm comm;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+    timer->exchange_bytes = 0;
+
+    prepare_all_to_many_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+    match_init(depth);
+    slots = pipeline_slots(recv_buf, r_lens, isagg ? procs : 0, depth);
+    stride = (isagg ? procs : 0) + cb_nodes;
+    pipe_requests = (MPI_Request*) malloc(sizeof(MPI_Request) * stride * depth);
+    counts = (int*) calloc(depth, sizeof(int));
+    (void) comm_size;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        d = m % depth;
+        if (counts[d]) {
+            start = MPI_Wtime();
+            MPI_Waitall(counts[d], pipe_requests + d * stride, MPI_STATUSES_IGNORE);
+            timer->recv_wait_all_time += MPI_Wtime() - start;
+        }
+        comm = match_comm(m);
+        start = MPI_Wtime();
+        j = 0;
+        if (isagg) {
+            for ( i = 0; i < procs; ++i ){
+                MPI_Irecv(slots[d] + (recv_buf[i] - recv_buf[0]), r_lens[i], MPI_BYTE, i, 0, comm, &pipe_requests[d * stride + j++]);
+                timer->exchange_bytes += r_lens[i];
             }
         }
+        for ( i = 0; i < cb_nodes; ++i ){
+            MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, rank_list[i], 0, comm, &pipe_requests[d * stride + j++]);
+        }
+        counts[d] = j;
+        timer->post_request_time += MPI_Wtime() - start;
+    }
+    start = MPI_Wtime();
+    for ( d = 0; d < depth; ++d ){
+        if (counts[d]) {
+            MPI_Waitall(counts[d], pipe_requests + d * stride, MPI_STATUSES_IGNORE);
+        }
+    }
+    timer->recv_wait_all_time += MPI_Wtime() - start;
+    timer->total_time += MPI_Wtime() - total_start;
 
-        if (method == 0 || method == 9){
-            all_to_many_pairwise(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many pairwise", timer1, max_timer1);
+    free(counts);
+    free(pipe_requests);
+    pipeline_slots_free(slots, depth);
+    match_free();
+    clean_all_to_many(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
+
+/*
+ * Many to all counterpart of all_to_many_pipelined.
+*/
+int many_to_all_pipelined(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int depth, Timer *timer, int iter, int ntimes){
+    double start, total_start;
+    int i, j, d, m, stride, myindex, *s_lens, *r_lens, *counts;
+    char **slots;
+    char **send_buf = NULL;
+    char **recv_buf = NULL;
+    MPI_Status *status;
+    MPI_Request *requests, *pipe_requests;
+    MPI_Comm comm;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+    timer->exchange_bytes = 0;
+
+    prepare_many_to_all_data(&send_buf, &recv_buf, &status, &requests, &myindex, &s_lens, &r_lens, rank, procs, isagg, cb_nodes, rank_list, data_size, iter, timer);
+    match_init(depth);
+    slots = pipeline_slots(recv_buf, r_lens, cb_nodes, depth);
+    stride = (isagg ? procs : 0) + cb_nodes;
+    pipe_requests = (MPI_Request*) malloc(sizeof(MPI_Request) * stride * depth);
+    counts = (int*) calloc(depth, sizeof(int));
+    (void) comm_size;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        d = m % depth;
+        if (counts[d]) {
+            start = MPI_Wtime();
+            MPI_Waitall(counts[d], pipe_requests + d * stride, MPI_STATUSES_IGNORE);
+            timer->recv_wait_all_time += MPI_Wtime() - start;
+        }
+        comm = match_comm(m);
+        start = MPI_Wtime();
+        j = 0;
+        for ( i = 0; i < cb_nodes; ++i ){
+            MPI_Irecv(slots[d] + (recv_buf[i] - recv_buf[0]), r_lens[i], MPI_BYTE, rank_list[i], 0, comm, &pipe_requests[d * stride + j++]);
+            timer->exchange_bytes += r_lens[i];
+        }
+        if (isagg) {
+            for ( i = 0; i < procs; ++i ){
+                MPI_Issend(send_buf[i], s_lens[i], MPI_BYTE, i, 0, comm, &pipe_requests[d * stride + j++]);
             }
         }
+        counts[d] = j;
+        timer->post_request_time += MPI_Wtime() - start;
+    }
+    start = MPI_Wtime();
+    for ( d = 0; d < depth; ++d ){
+        if (counts[d]) {
+            MPI_Waitall(counts[d], pipe_requests + d * stride, MPI_STATUSES_IGNORE);
+        }
+    }
+    timer->recv_wait_all_time += MPI_Wtime() - start;
+    timer->total_time += MPI_Wtime() - total_start;
 
-        if (method == 0 || method == 10){
-            many_to_all_pairwise(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all pairwise", timer1, max_timer1);
-            }
+    free(counts);
+    free(pipe_requests);
+    pipeline_slots_free(slots, depth);
+    match_free();
+    clean_many_to_all(rank, procs, cb_nodes, rank_list, myindex, iter, &send_buf, &recv_buf, &status, &requests, &s_lens, &r_lens, isagg, timer);
+    return 0;
+}
+
+/*
+ * Streaming exchange with memory bounded by the window (-S) instead of procs. Messages are cut into blocks of at most block bytes, where block is a
+ * multiple of 256. Since the payload pattern repeats every 256 bytes, a block can be generated and verified without knowing its offset in the
+ * message. STREAM_SLOTS send slots are generated just in time and Issend'ed. STREAM_SLOTS receive slots are posted with MPI_ANY_SOURCE, verified
+ * (if check is set) and reposted as they complete. Sizes are evaluated one peer at a time, so nothing of size procs is allocated.
+ * many_to_all 0: every rank sends to the cb_nodes aggregators, aggregators receive from all procs (all-to-many).
+ * many_to_all 1: aggregators send to all procs, every rank receives from the cb_nodes aggregators (many-to-all).
+*/
+typedef struct{
+    int rank;
+    int cb_nodes;
+    int *rank_list;
+    int myindex;
+    int data_size;
+    int many_to_all;
+    int block;
+    int iter;
+    /* Position of the message being sent (peers are visited from position rank on), its destination and size, and the next offset.*/
+    int nsends;
+    int q;
+    int pos;
+    int peer;
+    int len;
+    MPI_Aint off;
+}Stream_state;
+
+static int stream_next_message(Stream_state *st){
+    for ( ; st->q < st->nsends; st->q++ ){
+        st->pos = (st->q + st->rank) % st->nsends;
+        if (st->many_to_all){
+            st->peer = st->pos;
+            st->len = workload_pair_size(st->pos, st->myindex, st->cb_nodes, st->data_size);
+        } else {
+            st->peer = st->rank_list[st->pos];
+            st->len = workload_pair_size(st->rank, st->pos, st->cb_nodes, st->data_size);
+        }
+        st->off = 0;
+        if (st->len){
+            return 1;
         }
+    }
+    return 0;
+}
 
-        if (method == 0 || method == 11){
-            many_to_all_half_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all half sync", timer1, max_timer1);
-            }
+/* Generate the next block into buf and Issend it. Returns 0 when everything has been sent.*/
+static int stream_post_block(Stream_state *st, char *buf, MPI_Comm comm, MPI_Request *request, Timer *timer){
+    double start;
+    int count;
+    if (st->q >= st->nsends){
+        return 0;
+    }
+    if (st->off >= st->len){
+        st->q++;
+        if (!stream_next_message(st)){
+            return 0;
         }
+    }
+    count = st->len - st->off < st->block ? (int) (st->len - st->off) : st->block;
+    /* Message position pos was generated with seed pos (see prepare_all_to_many_data and prepare_many_to_all_data).*/
+    start = MPI_Wtime();
+    fill_buffer(st->rank, buf, count, st->pos, st->iter);
+    timer->setup_time += MPI_Wtime() - start;
+    start = MPI_Wtime();
+    MPI_Issend(buf, count, MPI_BYTE, st->peer, 0, comm, request);
+    timer->post_request_time += MPI_Wtime() - start;
+    st->off += count;
+    return 1;
+}
 
-        if (method == 0 || method == 12){
-            all_to_many_half_sync2(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many half sync 2", timer1, max_timer1);
+int stream_exchange(int rank, int procs, int isagg, int cb_nodes, int *rank_list, int myindex, int data_size, int many_to_all, int block, int check, int iter, MPI_Comm comm, Timer *timer){
+    Stream_state st;
+    MPI_Request requests[2 * STREAM_SLOTS];
+    MPI_Status status;
+    MPI_Aint nrecv_blocks = 0, nposted = 0;
+    double start;
+    char *ring;
+    int i, index, count, wrong;
+
+    /* Number of blocks this rank receives.*/
+    if (many_to_all){
+        for ( i = 0; i < cb_nodes; ++i ){
+            nrecv_blocks += (workload_pair_size(rank, i, cb_nodes, data_size) + (MPI_Aint) block - 1) / block;
+        }
+    } else if (isagg){
+        for ( i = 0; i < procs; ++i ){
+            nrecv_blocks += (workload_pair_size(i, myindex, cb_nodes, data_size) + (MPI_Aint) block - 1) / block;
+        }
+    }
+    st.rank = rank;
+    st.cb_nodes = cb_nodes;
+    st.rank_list = rank_list;
+    st.myindex = myindex;
+    st.data_size = data_size;
+    st.many_to_all = many_to_all;
+    st.block = block;
+    st.iter = iter;
+    st.nsends = many_to_all ? (isagg ? procs : 0) : cb_nodes;
+    st.q = 0;
+    stream_next_message(&st);
+    ring = comm_buf_alloc((MPI_Aint) 2 * STREAM_SLOTS * block);
+
+    /* Slots 0 to STREAM_SLOTS - 1 send, the others receive.*/
+    for ( i = 0; i < 2 * STREAM_SLOTS; ++i ){
+        requests[i] = MPI_REQUEST_NULL;
+    }
+    for ( i = STREAM_SLOTS; i < 2 * STREAM_SLOTS && nposted < nrecv_blocks; ++i ){
+        start = MPI_Wtime();
+        MPI_Irecv(ring + (MPI_Aint) i * block, block, MPI_BYTE, MPI_ANY_SOURCE, 0, comm, &requests[i]);
+        timer->post_request_time += MPI_Wtime() - start;
+        nposted++;
+    }
+    for ( i = 0; i < STREAM_SLOTS; ++i ){
+        if (!stream_post_block(&st, ring + (MPI_Aint) i * block, comm, &requests[i], timer)){
+            break;
+        }
+    }
+    while (1){
+        start = MPI_Wtime();
+        MPI_Waitany(2 * STREAM_SLOTS, requests, &index, &status);
+        timer->recv_wait_all_time += MPI_Wtime() - start;
+        if (index == MPI_UNDEFINED){
+            break;
+        }
+        if (index < STREAM_SLOTS){
+            stream_post_block(&st, ring + (MPI_Aint) index * block, comm, &requests[index], timer);
+            continue;
+        }
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        timer->exchange_bytes += count;
+        if (check){
+            wrong = check_buffer(status.MPI_SOURCE, ring + (MPI_Aint) index * block, count, many_to_all ? rank : myindex, iter);
+            if (wrong){
+                timer->corrupt_messages += 1;
+                timer->corrupt_bytes += wrong;
             }
         }
+        if (nposted < nrecv_blocks){
+            start = MPI_Wtime();
+            MPI_Irecv(ring + (MPI_Aint) index * block, block, MPI_BYTE, MPI_ANY_SOURCE, 0, comm, &requests[index]);
+            timer->post_request_time += MPI_Wtime() - start;
+            nposted++;
+        }
+    }
+    comm_buf_free(ring);
+    return 0;
+}
 
-        if (method == 0 || method == 13){
-            Timer *timers = (Timer*) malloc(sizeof(Timer)*ntimes);
-            all_to_many_scattered(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, barrier_type, &timer1, timers, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            save_all_timing(rank, procs, ntimes, comm_size, timers, prefix);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many scattered", timer1, max_timer1);
-            }
+/*
+ * Streaming all to many (many_to_all 0) or many to all (many_to_all 1), see stream_exchange. Received blocks are verified in the last repetition.
+ * Corrupted messages count corrupted blocks.
+*/
+int streaming_exchange(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int window, int many_to_all, Timer *timer, int iter, int ntimes){
+    double total_start;
+    int i, m, block, myindex = 0;
+    MPI_Comm comm;
+    timer->post_request_time = 0;
+    timer->recv_wait_all_time = 0;
+    timer->send_wait_all_time = 0;
+    timer->total_time = 0;
+    timer->setup_time = 0;
+    timer->exchange_bytes = 0;
+    timer->corrupt_messages = 0;
+    timer->corrupt_bytes = 0;
+
+    for ( i = 0; i < cb_nodes; ++i ){
+        if (rank_list[i] == rank){
+            myindex = i;
         }
+    }
+    block = window / (2 * STREAM_SLOTS) / 256 * 256;
+    if (block < 256){
+        block = 256;
+    }
+    /* Wildcard receives must not match anything but this exchange.*/
+    MPI_Comm_dup(MPI_COMM_WORLD, &comm);
 
-        if (method == 0 || method == 14){
-            many_to_all_scattered(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all scattered", timer1, max_timer1);
-            }
+    MPI_Barrier(MPI_COMM_WORLD);
+    total_start = MPI_Wtime();
+    for (m = 0; m < ntimes; ++m){
+        stream_exchange(rank, procs, isagg, cb_nodes, rank_list, myindex, data_size, many_to_all, block, verify && m == ntimes - 1, iter, comm, timer);
+    }
+    timer->total_time += MPI_Wtime() - total_start;
+    MPI_Comm_free(&comm);
+    return 0;
+}
+
+int create_aggregator_list(int rank, int procs, int cb_nodes, int proc_node, int type, int **rank_list, int *is_agg){
+    int *rank_list_ptr = (int*) malloc(sizeof(int)*cb_nodes);
+    int i;
+    *is_agg = 0;
+    schedule_aggregators(procs, cb_nodes, proc_node, type, rank_list_ptr);
+    for ( i = 0; i < cb_nodes; ++i ){
+        if (rank_list_ptr[i] == rank){
+            *is_agg = 1;
         }
+    }
+    *rank_list = rank_list_ptr;
+    return 0;
+}
 
-        if (method == 0 || method == 15){
-            all_to_many_tam(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many TAM", timer1, max_timer1);
-            }
+/*
+ * Fill the size tables of the stripe model workload. The aggregators are rank_list, already trimmed to the count ROMIO would use for this striping.
+*/
+int stripe_model_setup(int rank, int procs, int cb_nodes, int *rank_list, int data_size){
+    Stripe_model model;
+    int i, myindex = -1;
+    model.stripe_size = io_setting.stripe_size;
+    model.stripe_count = io_setting.stripe_count;
+    model.pattern = workload.pattern;
+    model.blocklen = data_size;
+    model.nblocks = workload.nblocks;
+    model.cyclic = (int) workload.param;
+    for ( i = 0; i < cb_nodes; ++i ){
+        if (rank_list[i] == rank){
+            myindex = i;
         }
+    }
+    workload.table_rank = rank;
+    workload.send_table = (int*) malloc(sizeof(int) * cb_nodes);
+    workload.recv_table = (int*) calloc(procs, sizeof(int));
+    stripe_model_sizes(rank, procs, cb_nodes, myindex, &model, workload.send_table, workload.recv_table);
+    return 0;
+}
 
-        if (method == 0 || method == 16){
-            many_to_all_tam(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all TAM", timer1, max_timer1);
-            }
+/*
+ * Read a replay trace collectively. The file is a flat array of Trace_record, every process reads an even slice of it with MPI-IO and the records are
+ * redistributed with Alltoallv, so each process ends up with exactly the records it sends or receives. No process ever holds the whole trace.
+ * Records with out-of-range ranks or negative sizes are dropped. nphases is one more than the largest phase id in the file.
+*/
+int load_trace(char *filename, int rank, int procs, Trace_record **records, int *nrecords, int *nphases){
+    MPI_File fh;
+    MPI_Offset file_size, total, start, end;
+    MPI_Datatype record_type;
+    Trace_record *slice, *sorted;
+    int *sendcounts, *recvcounts, *sdispls, *rdispls, *offsets;
+    int i, n, nrecv, max_phase = -1, dropped = 0, total_dropped;
+
+    err = MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    ERR
+    if (err != MPI_SUCCESS){
+        return 1;
+    }
+    MPI_File_get_size(fh, &file_size);
+    total = file_size / sizeof(Trace_record);
+    start = total * rank / procs;
+    end = total * (rank + 1) / procs;
+    n = (int) (end - start);
+
+    MPI_Type_contiguous(4, MPI_INT, &record_type);
+    MPI_Type_commit(&record_type);
+
+    slice = (Trace_record*) malloc(sizeof(Trace_record) * (n + 1));
+    err = MPI_File_read_at_all(fh, start * sizeof(Trace_record), slice, n, record_type, MPI_STATUS_IGNORE);
+    ERR
+    MPI_File_close(&fh);
+
+    sendcounts = (int*) calloc(procs, sizeof(int));
+    recvcounts = (int*) malloc(sizeof(int) * procs);
+    sdispls = (int*) malloc(sizeof(int) * procs);
+    rdispls = (int*) malloc(sizeof(int) * procs);
+    offsets = (int*) malloc(sizeof(int) * procs);
+
+    for ( i = 0; i < n; ++i ){
+        if (slice[i].src < 0 || slice[i].src >= procs || slice[i].dst < 0 || slice[i].dst >= procs || slice[i].bytes < 0 || slice[i].phase < 0){
+            slice[i].phase = -1;
+            dropped++;
+            continue;
+        }
+        sendcounts[slice[i].src]++;
+        if (slice[i].dst != slice[i].src){
+            sendcounts[slice[i].dst]++;
         }
+    }
+    sdispls[0] = 0;
+    for ( i = 1; i < procs; ++i ){
+        sdispls[i] = sdispls[i - 1] + sendcounts[i - 1];
+    }
+    memcpy(offsets, sdispls, sizeof(int) * procs);
+    sorted = (Trace_record*) malloc(sizeof(Trace_record) * (sdispls[procs - 1] + sendcounts[procs - 1] + 1));
+    for ( i = 0; i < n; ++i ){
+        if (slice[i].phase < 0){
+            continue;
+        }
+        sorted[offsets[slice[i].src]++] = slice[i];
+        if (slice[i].dst != slice[i].src){
+            sorted[offsets[slice[i].dst]++] = slice[i];
+        }
+    }
+    free(slice);
 
-        if (method == 0 || method == 17){
-            all_to_many_node_robin(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many node robin", timer1, max_timer1);
-            }
+    MPI_Alltoall(sendcounts, 1, MPI_INT, recvcounts, 1, MPI_INT, MPI_COMM_WORLD);
+    rdispls[0] = 0;
+    for ( i = 1; i < procs; ++i ){
+        rdispls[i] = rdispls[i - 1] + recvcounts[i - 1];
+    }
+    nrecv = rdispls[procs - 1] + recvcounts[procs - 1];
+    *records = (Trace_record*) malloc(sizeof(Trace_record) * (nrecv + 1));
+    MPI_Alltoallv(sorted, sendcounts, sdispls, record_type, *records, recvcounts, rdispls, record_type, MPI_COMM_WORLD);
+    *nrecords = nrecv;
+
+    for ( i = 0; i < nrecv; ++i ){
+        if (records[0][i].phase > max_phase){
+            max_phase = records[0][i].phase;
         }
+    }
+    MPI_Allreduce(&max_phase, nphases, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    nphases[0]++;
+    MPI_Reduce(&dropped, &total_dropped, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0){
+        printf("trace %s: %lld records, %d phases, %d invalid records dropped\n", filename, (long long) total, nphases[0], total_dropped);
+    }
 
-        if (method == 0 || method == 18){
-            all_to_many_balanced_control(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced control", timer1, max_timer1);
-            }
+    MPI_Type_free(&record_type);
+    free(sorted);
+    free(sendcounts);
+    free(recvcounts);
+    free(sdispls);
+    free(rdispls);
+    free(offsets);
+    return 0;
+}
+
+/*
+ * Turn one phase of a loaded trace into an all-to-many exchange. Every process that receives in the phase becomes an aggregator (rank_list is sorted),
+ * and the size tables of the trace workload are filled from the local records. Repeated (src, dst) pairs within a phase are merged, a merged
+ * pair is limited to INT_MAX bytes like every message of the methods. total_bytes is the volume of the phase summed over all processes.
+*/
+int trace_phase_setup(int rank, int procs, Trace_record *records, int nrecords, int phase, int *cb_nodes, int **rank_list, int *isagg, long long *total_bytes){
+    int *flags, *agg_index;
+    int i, clamped = 0, total_clamped;
+    long long local_bytes = 0;
+
+    *isagg = 0;
+    for ( i = 0; i < nrecords; ++i ){
+        if (records[i].phase == phase && records[i].dst == rank){
+            *isagg = 1;
+            break;
+        }
+    }
+    flags = (int*) malloc(sizeof(int) * procs);
+    agg_index = (int*) malloc(sizeof(int) * procs);
+    MPI_Allgather(isagg, 1, MPI_INT, flags, 1, MPI_INT, MPI_COMM_WORLD);
+    *cb_nodes = 0;
+    for ( i = 0; i < procs; ++i ){
+        agg_index[i] = cb_nodes[0];
+        cb_nodes[0] += flags[i];
+    }
+    *rank_list = (int*) malloc(sizeof(int) * (cb_nodes[0] + 1));
+    for ( i = 0; i < procs; ++i ){
+        if (flags[i]){
+            rank_list[0][agg_index[i]] = i;
         }
+    }
 
-        if (method == 0 || method == 19){
-            all_to_many_scattered_isend(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many scattered isend", timer1, max_timer1);
+    workload.type = WORKLOAD_TRACE;
+    workload.table_rank = rank;
+    workload.send_table = (int*) calloc(cb_nodes[0] + 1, sizeof(int));
+    workload.recv_table = (int*) calloc(procs, sizeof(int));
+    for ( i = 0; i < nrecords; ++i ){
+        if (records[i].phase != phase){
+            continue;
+        }
+        if (records[i].src == rank){
+            if (workload.send_table[agg_index[records[i].dst]] > INT_MAX - records[i].bytes){
+                workload.send_table[agg_index[records[i].dst]] = INT_MAX;
+                clamped++;
+            } else {
+                workload.send_table[agg_index[records[i].dst]] += records[i].bytes;
             }
         }
-
-        if (method == 0 || method == 20){
-            all_to_many_balanced_pre_send(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, i, ntimes);
-            MPI_Reduce((double*)(&timer1), (double*)(&max_timer1), 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-            if (rank == 0){
-                summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced presend", timer1, max_timer1);
+        if (records[i].dst == rank){
+            if (workload.recv_table[records[i].src] > INT_MAX - records[i].bytes){
+                workload.recv_table[records[i].src] = INT_MAX;
+            } else {
+                workload.recv_table[records[i].src] += records[i].bytes;
             }
         }
-        if (rank == 0){
-            printf("| --------------------------------------\n");
+    }
+    for ( i = 0; i < cb_nodes[0]; ++i ){
+        local_bytes += workload.send_table[i];
+    }
+    MPI_Allreduce(&local_bytes, total_bytes, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Reduce(&clamped, &total_clamped, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0 && total_clamped){
+        printf("trace phase %d: %d merged pairs exceed %d bytes and are cut to it\n", phase, total_clamped, INT_MAX);
+    }
+    workload.total_bytes = total_bytes[0];
+
+    free(flags);
+    free(agg_index);
+    return 0;
+}
+
+int trace_phase_clean(int **rank_list){
+    free(rank_list[0]);
+    free(workload.send_table);
+    free(workload.recv_table);
+    workload.send_table = NULL;
+    workload.recv_table = NULL;
+    workload.total_bytes = 0;
+    return 0;
+}
+
+int save_all_timing(int rank, int procs, int ntimes, int comm_size, Timer *timers, char *prefix) {
+    FILE* stream;
+    Timer *all_timers;
+    int i ,j;
+    char filename[200];
+    if (rank == 0) {
+        all_timers = (Timer*)malloc(sizeof(Timer)*ntimes*procs);
+    } else {
+        all_timers = NULL;
+    }
+    MPI_Gather(timers, sizeof(Timer)*ntimes, MPI_BYTE,
+                   all_timers, sizeof(Timer)*ntimes, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    if (rank!=0) {
+        return 0;
+    }
+    sprintf(filename,"%ssend_wait_all_times_%d.csv",prefix,comm_size);
+    stream = fopen(filename,"w");
+    for ( i = 0; i < procs; ++i ){
+        fprintf(stream, "%d",i);
+        for ( j = 0; j < ntimes; ++j ) {
+            fprintf(stream, ",%lf", all_timers[i*ntimes+j].send_wait_all_time);
+        }
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    sprintf(filename,"%stotal_times_%d.csv",prefix,comm_size);
+    stream = fopen(filename,"w");
+    for ( i = 0; i < procs; ++i ){
+        fprintf(stream, "%d",i);
+        for ( j = 0; j < ntimes; ++j ) {
+            fprintf(stream, ",%lf", all_timers[i*ntimes+j].total_time);
+        }
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    sprintf(filename,"%spost_request_time_%d.csv",prefix,comm_size);
+    stream = fopen(filename,"w");
+    for ( i = 0; i < procs; ++i ){
+        fprintf(stream, "%d",i);
+        for ( j = 0; j < ntimes; ++j ) {
+            fprintf(stream, ",%lf", all_timers[i*ntimes+j].post_request_time);
+        }
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    sprintf(filename,"%sbarrier_time_%d.csv",prefix,comm_size);
+    stream = fopen(filename,"w");
+    for ( i = 0; i < procs; ++i ){
+        fprintf(stream, "%d",i);
+        for ( j = 0; j < ntimes; ++j ) {
+            fprintf(stream, ",%lf", all_timers[i*ntimes+j].barrier_time);
+        }
+        fprintf(stream, "\n");
+    }
+    fclose(stream);
+    free(all_timers);
+    return 0;
+}
+
+int summarize_results(int procs, int cb_nodes, int data_size, int comm_size, int ntimes, int type, char* filename, char* prefix, Timer timer1,Timer max_timer1) {
+    FILE* stream;
+    printf("| --------------------------------------\n");
+    printf("| %s rank 0 request post time = %lf\n", prefix, timer1.post_request_time);
+    printf("| %s rank 0 send waitall time = %lf\n", prefix, timer1.send_wait_all_time);
+    printf("| %s rank 0 recv waitall time = %lf\n", prefix, timer1.recv_wait_all_time);
+    printf("| %s rank 0 total time = %lf\n", prefix, timer1.total_time);
+    printf("| %s max request post time = %lf\n", prefix, max_timer1.post_request_time);
+    printf("| %s max send waitall time = %lf\n", prefix, max_timer1.send_wait_all_time);
+    printf("| %s max recv waitall time = %lf\n", prefix, max_timer1.recv_wait_all_time);
+    printf("| %s max total time = %lf\n", prefix, max_timer1.total_time);
+    printf("| %s max setup time = %lf\n", prefix, max_timer1.setup_time);
+    if (max_timer1.copy_time > 0){
+        printf("| %s max proxy copy time = %lf (%d threads)\n", prefix, max_timer1.copy_time, tam_copy_threads);
+    }
+    if (max_timer1.compute_time > 0){
+        printf("| %s max exchange only time = %lf, max compute only time = %lf\n", prefix, max_timer1.comm_time, max_timer1.compute_time);
+        printf("| %s overlap max = %lf, min = %lf, mean = %lf\n", prefix, max_timer1.overlap, max_timer1.overlap_min, max_timer1.overlap_mean);
+    }
+    /* A replayed phase moves its trace volume in every repetition, whatever -d says.*/
+    if (max_timer1.exchange_bytes == 0){
+        max_timer1.exchange_bytes = (double) workload.total_bytes * ntimes;
+    }
+    if (max_timer1.exchange_bytes > 0 && max_timer1.total_time > 0){
+        printf("| %s bytes exchanged = %.0lf, throughput (MiB/s) = %lf, repetitions in flight = %d\n", prefix, max_timer1.exchange_bytes, max_timer1.exchange_bytes / max_timer1.total_time / 1048576, pipeline_depth);
+    }
+    if (cost_model.loaded){
+        printf("| %s max messages = %.0lf, max message bytes = %.0lf, max rounds = %.0lf, max copy bytes = %.0lf\n", prefix, max_timer1.messages, max_timer1.message_bytes, max_timer1.rounds, max_timer1.copy_bytes);
+        printf("| %s predicted time = %lf, measured max total time = %lf, measured / predicted = %lf\n", prefix, max_timer1.model_time, max_timer1.total_time, max_timer1.model_time > 0 ? max_timer1.total_time / max_timer1.model_time : 0);
+    }
+    if (verify){
+        printf("| %s corrupted messages = %.0lf, corrupted bytes = %.0lf\n", prefix, max_timer1.corrupt_messages, max_timer1.corrupt_bytes);
+    }
+    if (io_setting.method != IO_NONE){
+        printf("| %s max I/O time = %lf\n", prefix, max_timer1.io_time);
+        printf("| %s bytes written = %.0lf\n", prefix, max_timer1.io_bytes);
+        if (max_timer1.io_time > 0){
+            printf("| %s write bandwidth (MiB/s) = %lf, end-to-end bandwidth (MiB/s) = %lf\n", prefix, max_timer1.io_bytes / max_timer1.io_time / 1048576, max_timer1.io_bytes / (max_timer1.total_time / ntimes + max_timer1.io_time) / 1048576);
+        }
+    }
+    stream = fopen(filename,"r");
+    if (stream){
+        fclose(stream);
+        stream = fopen(filename,"a");
+    } else {
+        stream = fopen(filename,"w");
+        fprintf(stream,"Method,");
+        fprintf(stream,"# of processes,");
+        fprintf(stream,"# of aggregators,");
+        fprintf(stream,"data size,");
+        fprintf(stream,"max comm,");
+        fprintf(stream,"ntimes,");
+        fprintf(stream,"aggregator type,");
+        fprintf(stream,"rank 0 post_request_time,");
+        fprintf(stream,"rank 0 send waitall time,");
+        fprintf(stream,"rank 0 recv waitall time,");
+        fprintf(stream,"rank 0 total time,");
+        fprintf(stream,"max post_request_time,");
+        fprintf(stream,"max send waitall time,");
+        fprintf(stream,"max recv waitall time,");
+        fprintf(stream,"max total time,");
+        fprintf(stream,"max io time,");
+        fprintf(stream,"max setup time,");
+        fprintf(stream,"max proxy copy time,");
+        fprintf(stream,"proxy copy threads,");
+        fprintf(stream,"max exchange only time,");
+        fprintf(stream,"max compute only time,");
+        fprintf(stream,"max overlap,");
+        fprintf(stream,"min overlap,");
+        fprintf(stream,"mean overlap,");
+        fprintf(stream,"bytes written,");
+        fprintf(stream,"corrupted messages,");
+        fprintf(stream,"corrupted bytes,");
+        fprintf(stream,"bytes exchanged,");
+        fprintf(stream,"repetitions in flight,");
+        fprintf(stream,"max messages,");
+        fprintf(stream,"max message bytes,");
+        fprintf(stream,"max rounds,");
+        fprintf(stream,"max copy bytes,");
+        fprintf(stream,"predicted time\n");
+    }
+    fprintf(stream,"%s,",prefix);
+    fprintf(stream,"%d,",procs);
+    fprintf(stream,"%d,",cb_nodes);
+    fprintf(stream,"%d,",data_size);
+    fprintf(stream,"%d,",comm_size);
+    fprintf(stream,"%d,",ntimes);
+    fprintf(stream,"%d,",type);
+    fprintf(stream,"%lf,",timer1.post_request_time);
+    fprintf(stream,"%lf,",timer1.send_wait_all_time);
+    fprintf(stream,"%lf,",timer1.recv_wait_all_time);
+    fprintf(stream,"%lf,",timer1.total_time);
+    fprintf(stream,"%lf,",max_timer1.post_request_time);
+    fprintf(stream,"%lf,",max_timer1.send_wait_all_time);
+    fprintf(stream,"%lf,",max_timer1.recv_wait_all_time);
+    fprintf(stream,"%lf,",max_timer1.total_time);
+    fprintf(stream,"%lf,",max_timer1.io_time);
+    fprintf(stream,"%lf,",max_timer1.setup_time);
+    fprintf(stream,"%lf,",max_timer1.copy_time);
+    fprintf(stream,"%d,",tam_copy_threads);
+    fprintf(stream,"%lf,",max_timer1.comm_time);
+    fprintf(stream,"%lf,",max_timer1.compute_time);
+    fprintf(stream,"%lf,",max_timer1.overlap);
+    fprintf(stream,"%lf,",max_timer1.overlap_min);
+    fprintf(stream,"%lf,",max_timer1.overlap_mean);
+    fprintf(stream,"%.0lf,",max_timer1.io_bytes);
+    fprintf(stream,"%.0lf,",max_timer1.corrupt_messages);
+    fprintf(stream,"%.0lf,",max_timer1.corrupt_bytes);
+    fprintf(stream,"%.0lf,",max_timer1.exchange_bytes);
+    fprintf(stream,"%d,",pipeline_depth);
+    fprintf(stream,"%.0lf,",max_timer1.messages);
+    fprintf(stream,"%.0lf,",max_timer1.message_bytes);
+    fprintf(stream,"%.0lf,",max_timer1.rounds);
+    fprintf(stream,"%.0lf,",max_timer1.copy_bytes);
+    fprintf(stream,"%lf\n",max_timer1.model_time);
+    fclose(stream);
+    return 0;
+}
+
+/*
+ * Max total time of the first experiment (-i) of every method and the mean of the later ones. The first experiment is the one that touches
+ * and registers fresh buffers, later ones may reuse them (see -M).
+*/
+typedef struct{
+    char label[256];
+    double first;
+    double later;
+    int nlater;
+}Experiment_history;
+
+static Experiment_history *history = NULL;
+static int nhistory = 0;
+
+static int record_experiment(char *label, double total_time){
+    int i;
+    for ( i = 0; i < nhistory; ++i ){
+        if (!strcmp(history[i].label, label)){
+            break;
+        }
+    }
+    if (i == nhistory){
+        history = (Experiment_history*) realloc(history, sizeof(Experiment_history) * (nhistory + 1));
+        strcpy(history[i].label, label);
+        history[i].first = total_time;
+        history[i].later = 0;
+        history[i].nlater = 0;
+        nhistory++;
+        return 0;
+    }
+    history[i].later += total_time;
+    history[i].nlater++;
+    printf("| %s first experiment max total time = %lf, mean of %d later experiments = %lf\n", label, history[i].first, history[i].nlater, history[i].later / history[i].nlater);
+    return 0;
+}
+
+/* A sweep point starts a new history.*/
+static int clear_experiments(){
+    free(history);
+    history = NULL;
+    nhistory = 0;
+    return 0;
+}
+
+/*
+ * Read the cost model parameters written by mpi_sendrecv_test -c.
+*/
+static int load_cost_model(char *filename){
+    FILE *stream = fopen(filename, "r");
+    if (stream == NULL){
+        printf("cannot open cost model file %s\n", filename);
+        return 1;
+    }
+    if (fscanf(stream, " alpha = %lf overhead = %lf beta = %lf gamma = %lf", &cost_model.alpha, &cost_model.overhead, &cost_model.beta, &cost_model.gamma) != 4){
+        printf("%s is not a cost model file\n", filename);
+        fclose(stream);
+        return 1;
+    }
+    fclose(stream);
+    cost_model.loaded = 1;
+    net_count_traffic = 1;
+    return 0;
+}
+
+/* Start counting the traffic of the next method.*/
+static int reset_traffic(){
+    net_messages_sent = 0;
+    net_messages_received = 0;
+    net_bytes_sent = 0;
+    net_bytes_received = 0;
+    net_rounds = 0;
+    return 0;
+}
+
+/*
+ * Traffic of this process since reset_traffic and the time the cost model predicts for it. Sends and receives overlap, so the larger of the two counts.
+*/
+static int model_traffic(Timer *timer1){
+    timer1->messages = (double) (net_messages_sent > net_messages_received ? net_messages_sent : net_messages_received);
+    timer1->message_bytes = (double) (net_bytes_sent > net_bytes_received ? net_bytes_sent : net_bytes_received);
+    timer1->rounds = (double) net_rounds;
+    timer1->model_time = cost_model.alpha * timer1->rounds + cost_model.overhead * timer1->messages + cost_model.beta * timer1->message_bytes + cost_model.gamma * timer1->copy_bytes;
+    reset_traffic();
+    return 0;
+}
+
+int report_results(int rank, int procs, int cb_nodes, int data_size, int comm_size, int ntimes, int type, char* filename, char* name, char* suffix, Timer *timer1){
+    Timer max_timer1;
+    char label[256];
+    int nsums = (int) ((sizeof(Timer) - offsetof(Timer, io_bytes)) / sizeof(double));
+    model_traffic(timer1);
+    MPI_Reduce((double*)timer1, (double*)(&max_timer1), sizeof(Timer) / sizeof(double), MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    /* Written volume and corruption counts are totals over all processes, not maxima.*/
+    MPI_Reduce(&(timer1->io_bytes), &(max_timer1.io_bytes), nsums, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0){
+        sprintf(label, "%s%s", name, suffix);
+        summarize_results(procs, cb_nodes, data_size, comm_size, ntimes, type, filename, label, timer1[0], max_timer1);
+        record_experiment(label, max_timer1.total_time);
+    }
+    memset(timer1, 0, sizeof(Timer));
+    return 0;
+}
+
+/*
+ * Run one experiment of the selected method (0 runs all of them). suffix is appended to the method name in the report, e.g. the phase of a replayed trace.
+*/
+int run_methods(int rank, int isagg, int procs, int cb_nodes, int data_size, int *rank_list, int comm_size, int proc_node, int aggregator_type, int barrier_type, char *prefix, char *suffix, int method, int iter, int ntimes){
+    Timer timer1;
+    memset(&timer1, 0, sizeof(Timer));
+    if (progress_mode){
+        progress_start();
+    }
+    reset_traffic();
+    if (method == 0 || method == 1){
+        all_to_many(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many", suffix, &timer1);
+    }
+    if (method == 0 || method == 2){
+        many_to_all(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all", suffix, &timer1);
+    }
+    if (method == 0 || method == 3){
+        all_to_many_balanced(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced", suffix, &timer1);
+    }
+    if (method == 0 || method == 4){
+        many_to_all_balanced(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all balanced", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 5){
+        many_to_all_benchmark(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all benchmark", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 6){
+        all_to_many_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many sync", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 7){
+        all_to_many_half_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many half sync", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 8){
+        all_to_many_benchmark(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many benchmark", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 9){
+        all_to_many_pairwise(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many pairwise", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 10){
+        many_to_all_pairwise(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all pairwise", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 11){
+        many_to_all_half_sync(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all half sync", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 12){
+        all_to_many_half_sync2(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many half sync 2", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 13){
+        Timer *timers = (Timer*) malloc(sizeof(Timer)*ntimes);
+        all_to_many_scattered(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, barrier_type, &timer1, timers, iter, ntimes);
+        save_all_timing(rank, procs, ntimes, comm_size, timers, prefix);
+        free(timers);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many scattered", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 14){
+        many_to_all_scattered(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all scattered", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 15){
+        all_to_many_tam(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many TAM", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 16){
+        many_to_all_tam(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all TAM", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 17){
+        all_to_many_node_robin(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many node robin", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 18){
+        all_to_many_balanced_control(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced control", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 19){
+        all_to_many_scattered_isend(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many scattered isend", suffix, &timer1);
+    }
+
+    if (method == 0 || method == 20){
+        all_to_many_balanced_pre_send(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many balanced presend", suffix, &timer1);
+    }
+    if ((method == 0 && mpi_threads > 1) || method == 21){
+        all_to_many_threaded(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, mpi_threads, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many threaded", suffix, &timer1);
+    }
+    if ((method == 0 && mpi_threads > 1) || method == 22){
+        many_to_all_threaded(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, mpi_threads, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all threaded", suffix, &timer1);
+    }
+    if ((method == 0 && progress_mode) || method == 23){
+        /* The benchmark switches the progress thread itself, so a -P thread is paused meanwhile.*/
+        progress_stop();
+        all_to_many_overlap(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, 0, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many overlap", suffix, &timer1);
+        if (progress_available){
+            all_to_many_overlap(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, 1, &timer1, iter, ntimes);
+            report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many overlap progress thread", suffix, &timer1);
+        }
+        if (progress_mode){
+            progress_start();
+        }
+    }
+    if (method == 0 || method == 24){
+        all_to_many_pipelined(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, pipeline_depth, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many pipelined", suffix, &timer1);
+    }
+    if (method == 0 || method == 25){
+        many_to_all_pipelined(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, pipeline_depth, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all pipelined", suffix, &timer1);
+    }
+    if (method == 0 || method == 26){
+        streaming_exchange(rank, isagg, procs, cb_nodes, data_size, rank_list, stream_window, 0, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many streaming", suffix, &timer1);
+    }
+    if (method == 0 || method == 27){
+        streaming_exchange(rank, isagg, procs, cb_nodes, data_size, rank_list, stream_window, 1, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all streaming", suffix, &timer1);
+    }
+    if (method == 0 || method == 28){
+        all_to_many_hierarchical(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "All to many hierarchical", suffix, &timer1);
+    }
+    if (method == 0 || method == 29){
+        many_to_all_hierarchical(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, &timer1, iter, ntimes);
+        report_results(rank, procs, cb_nodes, data_size, comm_size, ntimes, aggregator_type, "results.csv", "Many to all hierarchical", suffix, &timer1);
+    }
+    if (progress_mode){
+        progress_stop();
+    }
+    return 0;
+}
+
+/*
+ * Set sweep to the values of a comma separated list, replacing those of an earlier occurrence of the option. An item is a value, lo:hi (step 1),
+ * lo:hi:s (step s) or lo:hi:xf (factor f, lo > 0). Returns 1 if the list is malformed.
+*/
+static int parse_sweep(char *arg, Sweep *sweep){
+    char *token, *end;
+    long lo, hi, step;
+    int geometric;
+    free(sweep->values);
+    sweep->values = NULL;
+    sweep->count = 0;
+    for ( token = strtok(arg, ","); token; token = strtok(NULL, ",") ){
+        lo = strtol(token, &end, 10);
+        if (end == token){
+            return 1;
+        }
+        hi = lo;
+        step = 1;
+        geometric = 0;
+        if (*end == ':'){
+            token = end + 1;
+            hi = strtol(token, &end, 10);
+            if (end == token){
+                return 1;
+            }
+            if (*end == ':'){
+                token = end + 1;
+                if (*token == 'x'){
+                    geometric = 1;
+                    token++;
+                }
+                step = strtol(token, &end, 10);
+                if (end == token){
+                    return 1;
+                }
+            }
+        }
+        if (*end || hi < lo || hi > INT_MAX || lo < INT_MIN || step < 1 + geometric || (geometric && lo < 1)){
+            return 1;
+        }
+        for ( ; lo <= hi; lo = geometric ? lo * step : lo + step ){
+            sweep->values = (int*) realloc(sweep->values, sizeof(int) * (sweep->count + 1));
+            sweep->values[sweep->count++] = (int) lo;
+        }
+    }
+    return 0;
+}
+
+/* An option that was not given sweeps its default value only.*/
+static int sweep_default(Sweep *sweep, int value){
+    if (sweep->count == 0){
+        sweep->values = (int*) malloc(sizeof(int));
+        sweep->values[0] = value;
+        sweep->count = 1;
+    }
+    return 0;
+}
+
+static int sweep_contains(Sweep *sweep, int value){
+    int i;
+    for ( i = 0; i < sweep->count; ++i ){
+        if (sweep->values[i] == value){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Methods that can replay a trace phase, used when -m 0 is combined with -f.*/
+static const int all_to_many_methods[] = {1, 3, 6, 7, 8, 9, 12, 13, 15, 17, 18, 19, 20, 21, 24, 28};
+
+int main(int argc, char **argv){
+    int rank, procs, cb_nodes = 1, method = 0, data_size = 0, proc_node = 1, isagg, i, comm_size = 200000000, iter = 1, ntimes = 1, aggregator_type = 1, barrier_type = 0;
+    int *rank_list, *rank_list2;
+    int nphases, nrecords, p, j, provided = MPI_THREAD_SINGLE, bad_option = 0, flag, *tag_ub;
+    int a, d, c, m, npoints, buf_mode_given = 0;
+    Sweep cb_sweep = {NULL, 0}, data_sweep = {NULL, 0}, comm_sweep = {NULL, 0}, method_sweep = {NULL, 0};
+    long long total_bytes, max_tag;
+    char prefix[200], trace_file[200], suffix[64], *token;
+    Trace_record *records;
+    prefix[0] = '\0';
+    trace_file[0] = '\0';
+
+    /* Options are parsed before MPI is initialized, because the thread level depends on -H.*/
+    workload.param = -1;
+    while ((i = getopt(argc, argv, "hp:c:m:d:a:i:k:t:r:b:w:s:z:f:o:e:g:q:x:y:v:T:H:P:W:D:S:M:N:L:C:E:A:")) != EOF){
+        switch(i) {
+            case 'm': 
+                bad_option |= parse_sweep(optarg, &method_sweep);
+                break;
+            case 'a': 
+                bad_option |= parse_sweep(optarg, &cb_sweep);
+                break;
+            case 'd': 
+                bad_option |= parse_sweep(optarg, &data_sweep);
+                break;
+            case 'c': 
+                bad_option |= parse_sweep(optarg, &comm_sweep);
+                break;
+            case 'i': 
+                iter = atoi(optarg);
+                break;
+            case 'p': 
+                proc_node = atoi(optarg);
+                break;
+            case 'k':
+                ntimes = atoi(optarg);
+                break;
+            case 't':
+                aggregator_type = atoi(optarg);
+                break;
+            case 'r':
+                strcpy(prefix, optarg);
+                break;
+            case 'b':
+                barrier_type = atoi(optarg);
+                break;
+            case 'w':
+                workload.type = atoi(optarg);
+                break;
+            case 's':
+                workload.seed = atoi(optarg);
+                break;
+            case 'z':
+                workload.param = atof(optarg);
+                break;
+            case 'f':
+                strcpy(trace_file, optarg);
+                break;
+            case 'o':
+                strcpy(io_setting.path, optarg);
+                break;
+            case 'e':
+                io_setting.method = atoi(optarg);
+                break;
+            case 'g':
+                io_setting.stripe_size = atoi(optarg);
+                break;
+            case 'q':
+                io_setting.stripe_count = atoi(optarg);
+                break;
+            case 'x':
+                workload.pattern = atoi(optarg);
+                break;
+            case 'y':
+                workload.nblocks = atoi(optarg);
+                break;
+            case 'v':
+                verify = atoi(optarg);
+                break;
+            case 'T':
+                tam_copy_threads = atoi(optarg);
+                break;
+            case 'H':
+                mpi_threads = atoi(optarg);
+                break;
+            case 'P':
+                progress_mode = atoi(optarg);
+                break;
+            case 'W':
+                tam_waitsome = atoi(optarg);
+                break;
+            case 'C':
+                tam_meta_collective = atoi(optarg);
+                break;
+            case 'D':
+                pipeline_depth = atoi(optarg);
+                break;
+            case 'S':
+                stream_window = atoi(optarg);
+                break;
+            case 'M':
+                comm_buf_mode = atoi(optarg);
+                buf_mode_given = 1;
+                break;
+            case 'N':
+                tam_numa_domains = atoi(optarg);
+                break;
+            case 'L':
+                hier_nlevels = 0;
+                for ( token = strtok(optarg, ","); token; token = strtok(NULL, ",") ){
+                    if (hier_nlevels == HIER_MAX_LEVELS){
+                        bad_option = 1;
+                        break;
+                    }
+                    hier_levels[hier_nlevels++] = atoi(token);
+                }
+                break;
+            case 'A':
+                bad_option |= load_cost_model(optarg);
+                break;
+            case 'E':
+                if (sscanf(optarg, "%lf,%lf", &net_emu_latency, &net_emu_bandwidth) < 1 || net_emu_latency < 0 || net_emu_bandwidth < 0){
+                    bad_option = 1;
+                }
+                net_emu_latency /= 1000000;
+                net_emu_bandwidth *= 1048576;
+                break;
+            default:
+                bad_option = 1;
+                break;
+        }
+    }
+    sweep_default(&method_sweep, method);
+    sweep_default(&cb_sweep, cb_nodes);
+    sweep_default(&data_sweep, data_size);
+    sweep_default(&comm_sweep, comm_size);
+    npoints = method_sweep.count * cb_sweep.count * data_sweep.count * comm_sweep.count;
+    method = method_sweep.values[0];
+    cb_nodes = cb_sweep.values[0];
+    data_size = data_sweep.values[0];
+    comm_size = comm_sweep.values[0];
+    if (mpi_threads > 1 || progress_mode || sweep_contains(&method_sweep, 23)){
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    } else {
+        MPI_Init(&argc, &argv);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+    MPI_Comm_size(MPI_COMM_WORLD,&procs);
+    if (bad_option){
+        if (rank==0) usage(argv[0]);
+        MPI_Finalize();
+        return 0;
+    }
+    if (mpi_threads > 1 && provided < MPI_THREAD_MULTIPLE){
+        if (rank == 0){
+            printf("MPI_THREAD_MULTIPLE is not supported (provided level %d), threaded methods run with one thread\n", provided);
+        }
+        mpi_threads = 1;
+    }
+    progress_available = provided >= MPI_THREAD_MULTIPLE;
+    if ((progress_mode || sweep_contains(&method_sweep, 23)) && !progress_available){
+        if (rank == 0){
+            printf("MPI_THREAD_MULTIPLE is not supported (provided level %d), running without the progress thread\n", provided);
+        }
+        progress_mode = 0;
+    }
+    if (mpi_threads < 1){
+        mpi_threads = 1;
+    }
+    if (net_emu_latency > 0 || net_emu_bandwidth > 0){
+        net_emulation_init(proc_node);
+    }
+    if (pipeline_depth < 1){
+        pipeline_depth = 1;
+    }
+    for ( i = 0; i < hier_nlevels; ++i ){
+        if (hier_levels[i] < 1 || (i && hier_levels[i] % hier_levels[i - 1])){
+            if (rank == 0){
+                printf("every -L group size must be a positive multiple of the previous one\n");
+            }
+            MPI_Finalize();
+            return 0;
+        }
+    }
+    /* Buffers are placed in the domain of the process that allocates them.*/
+    if (tam_numa_domains){
+        comm_buf_first_touch = 1;
+    }
+    /* Methods other than 24 to 27 build tags as rank + peer, up to 2 * procs - 2, and the half-sync signals as rank + 100 * peer.*/
+    MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &tag_ub, &flag);
+    max_tag = 101 * ((long long) procs - 1) > 2 * (long long) procs - 2 ? 101 * ((long long) procs - 1) : 2 * (long long) procs - 2;
+    if (flag && rank == 0 && max_tag > *tag_ub){
+        printf("warning: tags of up to %lld exceed MPI_TAG_UB = %d, only methods 24 to 27 are safe at this scale\n", max_tag, *tag_ub);
+    }
+    if (workload.param < 0){
+        if (workload.type == WORKLOAD_ZIPF){
+            workload.param = 1;
+        } else if (workload.type == WORKLOAD_SPARSE){
+            workload.param = 0.5;
+        } else if (workload.type == WORKLOAD_STRIPE){
+            workload.param = 2;
+        } else {
+            workload.param = 8;
+        }
+    }
+    if (io_setting.path[0] && io_setting.method == IO_NONE){
+        io_setting.method = IO_PWRITE;
+    }
+    if (!io_setting.path[0]){
+        io_setting.method = IO_NONE;
+    }
+    if (io_setting.stripe_size <= 0 || io_setting.stripe_count <= 0){
+        if (rank == 0){
+            printf("stripe size and stripe count must be positive\n");
+        }
+        MPI_Finalize();
+        return 0;
+    }
+    if (trace_file[0]){
+        if (npoints > 1){
+            if (rank == 0){
+                printf("a trace replay takes one value of -a, -d, -c and -m\n");
+            }
+            MPI_Finalize();
+            return 0;
+        }
+        for ( j = 0; j < (int) (sizeof(all_to_many_methods) / sizeof(int)); ++j ){
+            if (all_to_many_methods[j] == method){
+                break;
+            }
+        }
+        if (method != 0 && j == (int) (sizeof(all_to_many_methods) / sizeof(int))){
+            if (rank == 0){
+                printf("method %d is not an all-to-many method and cannot replay a trace\n", method);
+            }
+            MPI_Finalize();
+            return 0;
+        }
+        if (load_trace(trace_file, rank, procs, &records, &nrecords, &nphases)){
+            MPI_Finalize();
+            return 0;
+        }
+        for ( i = 0; i < iter; ++i ){
+            for ( p = 0; p < nphases; ++p ){
+                trace_phase_setup(rank, procs, records, nrecords, p, &cb_nodes, &rank_list2, &isagg, &total_bytes);
+                if (cb_nodes == 0){
+                    trace_phase_clean(&rank_list2);
+                    continue;
+                }
+                if (rank == 0){
+                    printf("| phase %d: aggregators = %d, total bytes = %lld\n", p, cb_nodes, total_bytes);
+                }
+                sprintf(suffix, " phase %d", p);
+                if (method == 0){
+                    for ( j = 0; j < (int) (sizeof(all_to_many_methods) / sizeof(int)); ++j ){
+                        run_methods(rank, isagg, procs, cb_nodes, data_size, rank_list2, comm_size, proc_node, aggregator_type, barrier_type, prefix, suffix, all_to_many_methods[j], i, ntimes);
+                    }
+                } else {
+                    run_methods(rank, isagg, procs, cb_nodes, data_size, rank_list2, comm_size, proc_node, aggregator_type, barrier_type, prefix, suffix, method, i, ntimes);
+                }
+                trace_phase_clean(&rank_list2);
+            }
+            if (rank == 0){
+                printf("| --------------------------------------\n");
+            }
+        }
+        free(records);
+        comm_buf_release();
+        MPI_Finalize();
+        return 0;
+    }
+
+    /* Without -M a sweep keeps its communication buffers in the pool, so that the later experiments (-i) of a point reuse them.*/
+    if (npoints > 1 && !buf_mode_given){
+        comm_buf_mode = COMM_BUF_POOL;
+    }
+    for ( a = 0; a < cb_sweep.count; ++a ){
+        for ( d = 0; d < data_sweep.count; ++d ){
+            cb_nodes = cb_sweep.values[a];
+            data_size = data_sweep.values[d];
+            if (workload.type == WORKLOAD_STRIPE){
+                cb_nodes = stripe_model_aggregators(cb_nodes, io_setting.stripe_count);
+            }
+            create_aggregator_list(rank, procs, cb_nodes, proc_node, aggregator_type, &rank_list, &isagg);
+            if (workload.type == WORKLOAD_STRIPE){
+                stripe_model_setup(rank, procs, cb_nodes, rank_list, data_size);
+            }
+            for ( c = 0; c < comm_sweep.count; ++c ){
+                for ( m = 0; m < method_sweep.count; ++m ){
+                    comm_size = comm_sweep.values[c];
+                    method = method_sweep.values[m];
+                    /* Every point starts with an empty pool and pays its own allocations, none runs on the pages of the point before.*/
+                    comm_buf_release();
+                    clear_experiments();
+                    if (rank == 0){
+                        if (npoints > 1){
+                            printf("sweep point %d of %d: cb_nodes = %d, data size = %d, comm_size = %d, method = %d\n", ((a * data_sweep.count + d) * comm_sweep.count + c) * method_sweep.count + m + 1, npoints, cb_nodes, data_size, comm_size, method);
+                        }
+                        printf("total number of processes = %d, cb_nodes = %d, proc_node = %d, data size = %d, comm_size = %d, ntimes=%d\n", procs, cb_nodes, proc_node, data_size, comm_size, ntimes);
+                        printf("workload = %d, seed = %d, parameter = %lf\n", workload.type, workload.seed, workload.param);
+                        if (mpi_threads > 1){
+                            printf("MPI threads per process = %d\n", mpi_threads);
+                        }
+                        if (progress_mode){
+                            printf("progress thread on\n");
+                        }
+                        if (pipeline_depth > 1){
+                            printf("repetitions in flight of the pipelined methods = %d\n", pipeline_depth);
+                        }
+                        if (comm_buf_mode){
+                            printf("communication buffer allocator = %d\n", comm_buf_mode);
+                        }
+                        if (hier_nlevels >= 0){
+                            printf("hierarchical levels =");
+                            for ( i = 0; i < hier_nlevels; ++i ){
+                                printf(" %d", hier_levels[i]);
+                            }
+                            printf("\n");
+                        }
+                        if (net_emu_latency > 0 || net_emu_bandwidth > 0){
+                            printf("network emulation between nodes of %d processes: latency = %lf us, bandwidth per node = %lf MiB/s (0: unlimited)\n", proc_node, net_emu_latency * 1000000, net_emu_bandwidth / 1048576);
+                        }
+                        if (tam_meta_collective){
+                            printf("TAM size exchange on node and proxy communicators\n");
+                        }
+                        if (tam_numa_domains){
+                            printf("NUMA domains per node = %d (-1: from sysfs), first-touch placement on\n", tam_numa_domains);
+                        }
+                        if (workload.type == WORKLOAD_STRIPE){
+                            printf("stripe size = %d, stripe count = %d, access pattern = %d, blocks per process = %d\n", io_setting.stripe_size, io_setting.stripe_count, workload.pattern, workload.nblocks);
+                        }
+                        if (io_setting.method != IO_NONE){
+                            printf("I/O file = %s, I/O method = %d, stripe size = %d, stripe count = %d\n", io_setting.path, io_setting.method, io_setting.stripe_size, io_setting.stripe_count);
+                        }
+
+                        printf("aggregators = ");
+                        for ( i = 0; i < cb_nodes; ++i ){
+                            printf("%d, ",rank_list[i]);
+                        }
+                        printf("\n");
+                    }
+                    for ( i = 0; i < iter; ++i ){
+                        run_methods(rank, isagg, procs, cb_nodes, data_size, rank_list, comm_size, proc_node, aggregator_type, barrier_type, prefix, "", method, i, ntimes);
+                        if (rank == 0){
+                            printf("| --------------------------------------\n");
+                        }
+                    }
+                }
+            }
+            if (workload.type == WORKLOAD_STRIPE){
+                free(workload.send_table);
+                free(workload.recv_table);
+            }
+            free(rank_list);
         }
     }
-    free(rank_list);
+    free(method_sweep.values);
+    free(cb_sweep.values);
+    free(data_sweep.values);
+    free(comm_sweep.values);
+    comm_buf_release();
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,781 @@
+/*
+ * Copyright (C) 2020, Northwestern University
+ * See COPYRIGHT notice in top-level directory.
+ *
+ * Network emulation for single-host runs. Ranks are grouped into virtual nodes of consecutive ranks, as the block assignment of
+ * static_node_assignment does. A point-to-point send that crosses a virtual node boundary reserves the injection link of the sending virtual
+ * node when it is posted (through the profiling interface, PMPI), which gives the time the message arrives: when the link has carried it, plus a
+ * fixed latency. The link is a token bucket shared by all ranks of the virtual node, so ranks of one node contend for its bandwidth as they would
+ * for a NIC. Posting never waits. Instead the completion calls (waits, tests and blocking calls) of both ends hold the message back until its
+ * arrival time. The receiver finds the arrival time on a board in shared memory, where the sender leaves it when it posts.
+ * The same wrappers count the point-to-point traffic of every process for the cost model of mpi_test.c.
+ */
+
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h> /* clock_gettime(), nanosleep() */
+
+/* Waits longer than this many nanoseconds sleep instead of spinning, up to the last NET_EMU_SPIN_NS.*/
+#ifndef NET_EMU_SPIN_NS
+#define NET_EMU_SPIN_NS 50000
+#endif
+/* Arrival times one sender can leave on the board of one receiver before it overwrites the oldest.*/
+#ifndef NET_EMU_BOARD_SLOTS
+#define NET_EMU_BOARD_SLOTS 32
+#endif
+/* Buckets of the table of requests in flight.*/
+#define NET_EMU_TABLE_SIZE 4096
+
+/* Latency in seconds and injection bandwidth of a virtual node in bytes per second (0: unlimited) of messages between virtual nodes.*/
+double net_emu_latency = 0;
+double net_emu_bandwidth = 0;
+
+/*
+ * Traffic of this process since the last reset: messages and bytes sent and received (messages to itself and to MPI_PROC_NULL are not counted)
+ * and rounds, the calls that complete at least one request or message (blocking sends and receives, MPI_Mrecv and the waits and tests that
+ * complete something). A probe is no round, the receive that follows it is. Sends are counted when they are posted, receives when they complete,
+ * with the size in their status. Only counted while net_count_traffic is set, which the cost model (-A) does.
+*/
+int net_count_traffic = 0;
+long long net_messages_sent = 0;
+long long net_messages_received = 0;
+long long net_bytes_sent = 0;
+long long net_bytes_received = 0;
+long long net_rounds = 0;
+
+/* Processes per virtual node, 0: emulation off.*/
+static int net_emu_ppn = 0;
+/* Time in nanoseconds at which the link of this virtual node is free again, shared by its processes.*/
+static long long *net_emu_link = NULL;
+static MPI_Win net_emu_win = MPI_WIN_NULL;
+/* World rank of every rank of a communicator, cached as an attribute.*/
+static int net_emu_keyval = MPI_KEYVAL_INVALID;
+static int *net_emu_world = NULL;
+static int net_emu_rank = 0;
+static pthread_mutex_t net_emu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Arrival board: the inbox of every process holds NET_EMU_BOARD_SLOTS entries per sender (by world rank). A sender fills the next of its slots
+ * with the tag and arrival time of a message between virtual nodes, the receive that matches it takes the oldest entry with that tag. state is
+ * 1 while an entry waits for its receive. Processes on another host have no inbox here (NULL).
+*/
+typedef struct{
+    long long arrival;
+    int tag;
+    int state;
+}Net_emu_board_entry;
+
+static Net_emu_board_entry **net_emu_board = NULL;
+static unsigned *net_emu_board_head = NULL;
+static MPI_Win net_emu_board_win = MPI_WIN_NULL;
+
+/*
+ * Requests in flight whose completion has to be held back or counted: sends between virtual nodes with their arrival time, and receives, whose
+ * arrival and size are looked up once MPI has matched them. Keyed by the bits of the handle, which MPI reuses only after the request is freed.
+*/
+typedef struct Net_emu_request{
+    unsigned long long key;
+    long long arrival;
+    int recv;
+    int resolved;
+    MPI_Comm comm;
+    MPI_Datatype datatype;
+    struct Net_emu_request *next;
+}Net_emu_request;
+
+static Net_emu_request *net_emu_table[NET_EMU_TABLE_SIZE];
+static int net_emu_tracked = 0;
+
+static long long net_emu_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Spin or sleep until the time end in nanoseconds.*/
+static void net_emu_hold(long long end){
+    struct timespec delay;
+    long long now;
+    while ((now = net_emu_now()) < end){
+        if (end - now > NET_EMU_SPIN_NS){
+            delay.tv_sec = (end - now - NET_EMU_SPIN_NS) / 1000000000LL;
+            delay.tv_nsec = (end - now - NET_EMU_SPIN_NS) % 1000000000LL;
+            nanosleep(&delay, NULL);
+        }
+    }
+}
+
+static int net_emu_delete(MPI_Comm comm, int keyval, void *attribute_val, void *extra_state){
+    (void) comm;
+    (void) keyval;
+    (void) extra_state;
+    free(attribute_val);
+    return MPI_SUCCESS;
+}
+
+static int *net_emu_world_ranks(MPI_Comm comm){
+    MPI_Group group, world_group;
+    int *world, *ranks, size, i, flag;
+    if (comm == MPI_COMM_WORLD){
+        return net_emu_world;
+    }
+    PMPI_Comm_get_attr(comm, net_emu_keyval, &world, &flag);
+    if (flag){
+        return world;
+    }
+    pthread_mutex_lock(&net_emu_lock);
+    PMPI_Comm_get_attr(comm, net_emu_keyval, &world, &flag);
+    if (!flag){
+        PMPI_Comm_size(comm, &size);
+        world = (int*) malloc(sizeof(int) * size);
+        ranks = (int*) malloc(sizeof(int) * size);
+        for ( i = 0; i < size; ++i ){
+            ranks[i] = i;
+        }
+        PMPI_Comm_group(comm, &group);
+        PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+        PMPI_Group_translate_ranks(group, size, ranks, world_group, world);
+        PMPI_Group_free(&group);
+        PMPI_Group_free(&world_group);
+        free(ranks);
+        PMPI_Comm_set_attr(comm, net_emu_keyval, world);
+    }
+    pthread_mutex_unlock(&net_emu_lock);
+    return world;
+}
+
+static unsigned long long net_emu_key(const void *handle, size_t size){
+    unsigned long long key = 0;
+    memcpy(&key, handle, size < sizeof(key) ? size : sizeof(key));
+    return key;
+}
+
+static Net_emu_request **net_emu_bucket(unsigned long long key){
+    key = (key ^ (key >> 31)) * 0xBF58476D1CE4E5B9ULL;
+    return &net_emu_table[(key ^ (key >> 29)) % NET_EMU_TABLE_SIZE];
+}
+
+static void net_emu_track(unsigned long long key, long long arrival, int recv, MPI_Datatype datatype, MPI_Comm comm){
+    Net_emu_request *entry = (Net_emu_request*) malloc(sizeof(Net_emu_request)), **bucket;
+    entry->key = key;
+    entry->arrival = arrival;
+    entry->recv = recv;
+    entry->resolved = !recv;
+    entry->comm = comm;
+    entry->datatype = datatype;
+    pthread_mutex_lock(&net_emu_lock);
+    bucket = net_emu_bucket(key);
+    entry->next = *bucket;
+    *bucket = entry;
+    __atomic_fetch_add(&net_emu_tracked, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&net_emu_lock);
+}
+
+/* Entry of the request with key, NULL if it is not held back. Only the thread that completes the request uses the entry.*/
+static Net_emu_request *net_emu_find(unsigned long long key){
+    Net_emu_request *entry;
+    if (!__atomic_load_n(&net_emu_tracked, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+    pthread_mutex_lock(&net_emu_lock);
+    for ( entry = *net_emu_bucket(key); entry && entry->key != key; entry = entry->next );
+    pthread_mutex_unlock(&net_emu_lock);
+    return entry;
+}
+
+static void net_emu_untrack(Net_emu_request *entry){
+    Net_emu_request **prev;
+    pthread_mutex_lock(&net_emu_lock);
+    for ( prev = net_emu_bucket(entry->key); *prev != entry; prev = &((*prev)->next) );
+    *prev = entry->next;
+    __atomic_fetch_sub(&net_emu_tracked, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&net_emu_lock);
+    free(entry);
+}
+
+static int net_tracking(){
+    return net_emu_ppn || net_count_traffic;
+}
+
+static void net_count(long long *messages, long long *bytes, MPI_Count count, MPI_Datatype type, int peer, MPI_Comm comm){
+    MPI_Count size;
+    int rank;
+    if (!net_count_traffic || peer == MPI_PROC_NULL){
+        return;
+    }
+    PMPI_Comm_rank(comm, &rank);
+    if (peer == rank){
+        return;
+    }
+    PMPI_Type_size_x(type, &size);
+    __atomic_fetch_add(messages, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(bytes, (long long) (size * count), __ATOMIC_RELAXED);
+}
+
+/* Count a message received into datatype on comm with status. Cancelled receives are not counted.*/
+static void net_received(MPI_Status *status, MPI_Datatype datatype, MPI_Comm comm){
+    int count, cancelled;
+    if (!net_count_traffic || status->MPI_SOURCE == MPI_PROC_NULL){
+        return;
+    }
+    PMPI_Test_cancelled(status, &cancelled);
+    if (cancelled){
+        return;
+    }
+    PMPI_Get_count(status, datatype, &count);
+    net_count(&net_messages_received, &net_bytes_received, count == MPI_UNDEFINED ? 0 : count, datatype, status->MPI_SOURCE, comm);
+}
+
+static void net_round(){
+    if (net_count_traffic){
+        __atomic_fetch_add(&net_rounds, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Reserve the link of this virtual node for a message of count elements of type to dest and return the time it arrives in nanoseconds, 0 for a
+ * message inside a virtual node or to MPI_PROC_NULL. The arrival time is also left on the board of the receiver.
+*/
+static long long net_emu_post(MPI_Count count, MPI_Datatype type, int dest, int tag, MPI_Comm comm){
+    Net_emu_board_entry *entry;
+    long long now, next, start, end;
+    MPI_Count size;
+    int *world, rank;
+    unsigned slot;
+    if (!net_emu_ppn || dest == MPI_PROC_NULL){
+        return 0;
+    }
+    world = net_emu_world_ranks(comm);
+    PMPI_Comm_rank(comm, &rank);
+    dest = world[dest];
+    if (world[rank] / net_emu_ppn == dest / net_emu_ppn){
+        return 0;
+    }
+    PMPI_Type_size_x(type, &size);
+    now = net_emu_now();
+    end = now;
+    if (net_emu_bandwidth > 0){
+        next = __atomic_load_n(net_emu_link, __ATOMIC_ACQUIRE);
+        do {
+            start = next > now ? next : now;
+            end = start + (long long) ((double) size * count / net_emu_bandwidth * 1e9);
+        } while (!__atomic_compare_exchange_n(net_emu_link, &next, end, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    }
+    end += (long long) (net_emu_latency * 1e9);
+    if (net_emu_board[dest] != NULL){
+        slot = __atomic_fetch_add(&net_emu_board_head[dest], 1, __ATOMIC_RELAXED) % NET_EMU_BOARD_SLOTS;
+        entry = net_emu_board[dest] + (MPI_Aint) net_emu_rank * NET_EMU_BOARD_SLOTS + slot;
+        __atomic_store_n(&entry->state, 0, __ATOMIC_RELEASE);
+        entry->arrival = end;
+        entry->tag = tag;
+        __atomic_store_n(&entry->state, 1, __ATOMIC_RELEASE);
+    }
+    return end;
+}
+
+/*
+ * Arrival time of a message received with status on comm, taken off the board. 0 for a message from the same virtual node, a cancelled receive
+ * or a message the board does not hold.
+*/
+static long long net_emu_arrival(MPI_Status *status, MPI_Comm comm){
+    Net_emu_board_entry *inbox, *oldest;
+    long long arrival;
+    int i, source, cancelled, expected;
+    if (!net_emu_ppn || status->MPI_SOURCE == MPI_PROC_NULL || net_emu_board[net_emu_rank] == NULL){
+        return 0;
+    }
+    PMPI_Test_cancelled(status, &cancelled);
+    if (cancelled){
+        return 0;
+    }
+    source = net_emu_world_ranks(comm)[status->MPI_SOURCE];
+    if (source / net_emu_ppn == net_emu_rank / net_emu_ppn){
+        return 0;
+    }
+    inbox = net_emu_board[net_emu_rank] + (MPI_Aint) source * NET_EMU_BOARD_SLOTS;
+    while (1){
+        oldest = NULL;
+        for ( i = 0; i < NET_EMU_BOARD_SLOTS; ++i ){
+            if (__atomic_load_n(&inbox[i].state, __ATOMIC_ACQUIRE) == 1 && inbox[i].tag == status->MPI_TAG && (oldest == NULL || inbox[i].arrival < oldest->arrival)){
+                oldest = inbox + i;
+            }
+        }
+        if (oldest == NULL){
+            return 0;
+        }
+        arrival = oldest->arrival;
+        expected = 1;
+        if (__atomic_compare_exchange_n(&oldest->state, &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+            return arrival;
+        }
+    }
+}
+
+/*
+ * Nonzero if request may complete now: MPI has completed it and its arrival time has passed. The request stays active, status receives its
+ * status once MPI has completed it.
+*/
+static int net_emu_ready(MPI_Request request, MPI_Status *status){
+    Net_emu_request *entry;
+    int flag;
+    PMPI_Request_get_status(request, &flag, status);
+    if (!flag || request == MPI_REQUEST_NULL || (entry = net_emu_find(net_emu_key(&request, sizeof(MPI_Request)))) == NULL){
+        return flag;
+    }
+    if (!entry->resolved){
+        entry->arrival = net_emu_arrival(status, entry->comm);
+        entry->resolved = 1;
+    }
+    return net_emu_now() >= entry->arrival;
+}
+
+/*
+ * The request with key has completed with status. Counts it if it is a receive, drops its entry and returns the time until which the completion
+ * is held back.
+*/
+static long long net_emu_complete(unsigned long long key, MPI_Status *status){
+    Net_emu_request *entry = net_emu_find(key);
+    long long arrival;
+    if (entry == NULL){
+        return 0;
+    }
+    if (!entry->resolved){
+        entry->arrival = net_emu_arrival(status, entry->comm);
+    }
+    if (entry->recv){
+        net_received(status, entry->datatype, entry->comm);
+    }
+    arrival = entry->arrival;
+    net_emu_untrack(entry);
+    return arrival;
+}
+
+/* A send that arrives at arrival (0: at once) is held back by the completion calls.*/
+static void net_emu_track_send(MPI_Request *request, long long arrival){
+    if (arrival){
+        net_emu_track(net_emu_key(request, sizeof(MPI_Request)), arrival, 0, MPI_DATATYPE_NULL, MPI_COMM_NULL);
+    }
+}
+
+/*
+ * The completion calls count a receive from source into datatype, and if it may come from another virtual node look its arrival up on the board.
+*/
+static void net_emu_track_recv(MPI_Request *request, MPI_Datatype datatype, int source, MPI_Comm comm){
+    int *world, rank;
+    if (!net_tracking() || source == MPI_PROC_NULL){
+        return;
+    }
+    if (!net_count_traffic && source != MPI_ANY_SOURCE){
+        world = net_emu_world_ranks(comm);
+        PMPI_Comm_rank(comm, &rank);
+        if (world[rank] / net_emu_ppn == world[source] / net_emu_ppn){
+            return;
+        }
+    }
+    net_emu_track(net_emu_key(request, sizeof(MPI_Request)), 0, 1, datatype, comm);
+}
+
+/* Keys of the requests in flight of an array, 0 for MPI_REQUEST_NULL.*/
+static unsigned long long *net_emu_keys(int count, MPI_Request *requests){
+    unsigned long long *keys = (unsigned long long*) malloc(sizeof(unsigned long long) * (count + 1));
+    int i;
+    for ( i = 0; i < count; ++i ){
+        keys[i] = requests[i] == MPI_REQUEST_NULL ? 0 : net_emu_key(requests + i, sizeof(MPI_Request));
+    }
+    return keys;
+}
+
+/*
+ * Start the emulation with ppn processes per virtual node. Collective over MPI_COMM_WORLD, after MPI_Init.
+*/
+int net_emulation_init(int ppn){
+    MPI_Comm node_comm, shared_comm, host_comm;
+    MPI_Group host_group, world_group;
+    MPI_Aint bytes;
+    Net_emu_board_entry *inbox;
+    int rank, size, i, disp_unit, *host_ranks;
+    if (ppn < 1){
+        return 1;
+    }
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &size);
+    net_emu_rank = rank;
+    net_emu_world = (int*) malloc(sizeof(int) * size);
+    for ( i = 0; i < size; ++i ){
+        net_emu_world[i] = i;
+    }
+    PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, net_emu_delete, &net_emu_keyval, NULL);
+    /* The bucket lives in shared memory, a virtual node that spans hosts gets one bucket per host.*/
+    PMPI_Comm_split(MPI_COMM_WORLD, rank / ppn, rank, &node_comm);
+    PMPI_Comm_split_type(node_comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &shared_comm);
+    PMPI_Comm_rank(shared_comm, &i);
+    PMPI_Win_allocate_shared(i ? 0 : sizeof(long long), sizeof(long long), MPI_INFO_NULL, shared_comm, &net_emu_link, &net_emu_win);
+    PMPI_Win_shared_query(net_emu_win, 0, &bytes, &disp_unit, &net_emu_link);
+    if (i == 0){
+        net_emu_link[0] = 0;
+    }
+    PMPI_Barrier(shared_comm);
+    PMPI_Comm_free(&shared_comm);
+    PMPI_Comm_free(&node_comm);
+    /* Every process of the host can write to the inbox of every other.*/
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &host_comm);
+    PMPI_Win_allocate_shared((MPI_Aint) sizeof(Net_emu_board_entry) * NET_EMU_BOARD_SLOTS * size, sizeof(Net_emu_board_entry), MPI_INFO_NULL, host_comm, &inbox, &net_emu_board_win);
+    memset(inbox, 0, sizeof(Net_emu_board_entry) * NET_EMU_BOARD_SLOTS * size);
+    net_emu_board = (Net_emu_board_entry**) calloc(size, sizeof(Net_emu_board_entry*));
+    net_emu_board_head = (unsigned*) calloc(size, sizeof(unsigned));
+    host_ranks = (int*) malloc(sizeof(int) * size);
+    PMPI_Comm_group(host_comm, &host_group);
+    PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+    PMPI_Group_translate_ranks(world_group, size, net_emu_world, host_group, host_ranks);
+    for ( i = 0; i < size; ++i ){
+        if (host_ranks[i] != MPI_UNDEFINED){
+            PMPI_Win_shared_query(net_emu_board_win, host_ranks[i], &bytes, &disp_unit, net_emu_board + i);
+        }
+    }
+    PMPI_Group_free(&host_group);
+    PMPI_Group_free(&world_group);
+    free(host_ranks);
+    PMPI_Barrier(host_comm);
+    PMPI_Comm_free(&host_comm);
+    net_emu_ppn = ppn;
+    return 0;
+}
+
+static int net_emulation_free(){
+    if (!net_emu_ppn){
+        return 0;
+    }
+    net_emu_ppn = 0;
+    PMPI_Win_free(&net_emu_win);
+    PMPI_Win_free(&net_emu_board_win);
+    PMPI_Comm_free_keyval(&net_emu_keyval);
+    free(net_emu_world);
+    free(net_emu_board);
+    free(net_emu_board_head);
+    net_emu_world = NULL;
+    return 0;
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm){
+    long long arrival = net_emu_post(count, datatype, dest, tag, comm);
+    int err;
+    net_count(&net_messages_sent, &net_bytes_sent, count, datatype, dest, comm);
+    net_round();
+    err = PMPI_Send(buf, count, datatype, dest, tag, comm);
+    net_emu_hold(arrival);
+    return err;
+}
+
+int MPI_Ssend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm){
+    long long arrival = net_emu_post(count, datatype, dest, tag, comm);
+    int err;
+    net_count(&net_messages_sent, &net_bytes_sent, count, datatype, dest, comm);
+    net_round();
+    err = PMPI_Ssend(buf, count, datatype, dest, tag, comm);
+    net_emu_hold(arrival);
+    return err;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm, MPI_Request *request){
+    long long arrival = net_emu_post(count, datatype, dest, tag, comm);
+    int err;
+    net_count(&net_messages_sent, &net_bytes_sent, count, datatype, dest, comm);
+    err = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+    net_emu_track_send(request, arrival);
+    return err;
+}
+
+int MPI_Issend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm, MPI_Request *request){
+    long long arrival = net_emu_post(count, datatype, dest, tag, comm);
+    int err;
+    net_count(&net_messages_sent, &net_bytes_sent, count, datatype, dest, comm);
+    err = PMPI_Issend(buf, count, datatype, dest, tag, comm, request);
+    net_emu_track_send(request, arrival);
+    return err;
+}
+
+#if MPI_VERSION >= 4
+int MPI_Issend_c(const void *buf, MPI_Count count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm, MPI_Request *request){
+    long long arrival = net_emu_post(count, datatype, dest, tag, comm);
+    int err;
+    net_count(&net_messages_sent, &net_bytes_sent, count, datatype, dest, comm);
+    err = PMPI_Issend_c(buf, count, datatype, dest, tag, comm, request);
+    net_emu_track_send(request, arrival);
+    return err;
+}
+
+int MPI_Irecv_c(void *buf, MPI_Count count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Request *request){
+    int err = PMPI_Irecv_c(buf, count, datatype, source, tag, comm, request);
+    net_emu_track_recv(request, datatype, source, comm);
+    return err;
+}
+#endif
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag, void *recvbuf, int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status *status){
+    long long arrival, end;
+    MPI_Status local;
+    int err;
+    if (!net_tracking()){
+        return PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, status);
+    }
+    arrival = net_emu_post(sendcount, sendtype, dest, sendtag, comm);
+    net_count(&net_messages_sent, &net_bytes_sent, sendcount, sendtype, dest, comm);
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    err = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount, recvtype, source, recvtag, comm, status);
+    net_received(status, recvtype, comm);
+    net_round();
+    end = net_emu_arrival(status, comm);
+    net_emu_hold(end > arrival ? end : arrival);
+    return err;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Status *status){
+    MPI_Status local;
+    int err;
+    if (!net_tracking()){
+        return PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    }
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    err = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+    net_received(status, datatype, comm);
+    net_round();
+    net_emu_hold(net_emu_arrival(status, comm));
+    return err;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm, MPI_Request *request){
+    int err = PMPI_Irecv(buf, count, datatype, source, tag, comm, request);
+    net_emu_track_recv(request, datatype, source, comm);
+    return err;
+}
+
+/* The communicator of a message found by MPI_Improbe, for the MPI_Mrecv that receives it.*/
+int MPI_Improbe(int source, int tag, MPI_Comm comm, int *flag, MPI_Message *message, MPI_Status *status){
+    int err = PMPI_Improbe(source, tag, comm, flag, message, status);
+    if (net_tracking() && *flag && *message != MPI_MESSAGE_NO_PROC){
+        net_emu_track(net_emu_key(message, sizeof(MPI_Message)), 0, 1, MPI_DATATYPE_NULL, comm);
+    }
+    return err;
+}
+
+int MPI_Mrecv(void *buf, int count, MPI_Datatype datatype, MPI_Message *message, MPI_Status *status){
+    unsigned long long key;
+    Net_emu_request *entry;
+    MPI_Status local;
+    int err;
+    if (!net_tracking()){
+        return PMPI_Mrecv(buf, count, datatype, message, status);
+    }
+    key = net_emu_key(message, sizeof(MPI_Message));
+    if ((entry = net_emu_find(key)) != NULL){
+        entry->datatype = datatype;
+    }
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    err = PMPI_Mrecv(buf, count, datatype, message, status);
+    net_round();
+    net_emu_hold(net_emu_complete(key, status));
+    return err;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status){
+    unsigned long long key;
+    MPI_Status local;
+    int err;
+    if (!net_tracking() || *request == MPI_REQUEST_NULL){
+        return PMPI_Wait(request, status);
+    }
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    key = net_emu_key(request, sizeof(MPI_Request));
+    err = PMPI_Wait(request, status);
+    net_round();
+    net_emu_hold(net_emu_complete(key, status));
+    return err;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[], MPI_Status array_of_statuses[]){
+    MPI_Status *statuses = array_of_statuses;
+    unsigned long long *keys;
+    long long end = 0, arrival;
+    int i, active = 0, err;
+    if (!net_tracking()){
+        return PMPI_Waitall(count, array_of_requests, array_of_statuses);
+    }
+    keys = net_emu_keys(count, array_of_requests);
+    if (statuses == MPI_STATUSES_IGNORE){
+        statuses = (MPI_Status*) malloc(sizeof(MPI_Status) * (count + 1));
+    }
+    err = PMPI_Waitall(count, array_of_requests, statuses);
+    for ( i = 0; i < count; ++i ){
+        if (keys[i]){
+            active = 1;
+            arrival = net_emu_complete(keys[i], statuses + i);
+            end = arrival > end ? arrival : end;
+        }
+    }
+    if (active){
+        net_round();
+    }
+    net_emu_hold(end);
+    if (statuses != array_of_statuses){
+        free(statuses);
+    }
+    free(keys);
+    return err;
+}
+
+/* Under emulation a test reports a request complete only once its arrival time has passed.*/
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status){
+    unsigned long long key;
+    MPI_Status local;
+    int err;
+    if (!net_tracking() || *request == MPI_REQUEST_NULL){
+        return PMPI_Test(request, flag, status);
+    }
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    if (net_emu_ppn && !net_emu_ready(*request, status)){
+        *flag = 0;
+        return MPI_SUCCESS;
+    }
+    key = net_emu_key(request, sizeof(MPI_Request));
+    err = PMPI_Test(request, flag, status);
+    if (*flag){
+        net_round();
+        net_emu_complete(key, status);
+    }
+    return err;
+}
+
+int MPI_Testall(int count, MPI_Request array_of_requests[], int *flag, MPI_Status array_of_statuses[]){
+    MPI_Status *statuses = array_of_statuses;
+    unsigned long long *keys;
+    int i, active = 0, err = MPI_SUCCESS;
+    if (!net_tracking()){
+        return PMPI_Testall(count, array_of_requests, flag, array_of_statuses);
+    }
+    if (statuses == MPI_STATUSES_IGNORE){
+        statuses = (MPI_Status*) malloc(sizeof(MPI_Status) * (count + 1));
+    }
+    keys = net_emu_keys(count, array_of_requests);
+    *flag = 1;
+    for ( i = 0; i < count && *flag && net_emu_ppn; ++i ){
+        *flag = net_emu_ready(array_of_requests[i], statuses + i);
+    }
+    if (*flag){
+        err = PMPI_Testall(count, array_of_requests, flag, statuses);
+        for ( i = 0; i < count && *flag; ++i ){
+            if (keys[i]){
+                active = 1;
+                net_emu_complete(keys[i], statuses + i);
+            }
+        }
+    }
+    if (active){
+        net_round();
+    }
+    if (statuses != array_of_statuses){
+        free(statuses);
+    }
+    free(keys);
+    return err;
+}
+
+/* Under emulation polls until some request may complete, see net_emu_ready.*/
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *index, MPI_Status *status){
+    unsigned long long key, *keys;
+    MPI_Status local;
+    int i, active = 1, err;
+    if (!net_tracking()){
+        return PMPI_Waitany(count, array_of_requests, index, status);
+    }
+    if (status == MPI_STATUS_IGNORE){
+        status = &local;
+    }
+    while (active && net_emu_ppn){
+        active = 0;
+        for ( i = 0; i < count; ++i ){
+            if (array_of_requests[i] == MPI_REQUEST_NULL){
+                continue;
+            }
+            active = 1;
+            if (net_emu_ready(array_of_requests[i], status)){
+                key = net_emu_key(array_of_requests + i, sizeof(MPI_Request));
+                err = PMPI_Wait(array_of_requests + i, status);
+                net_round();
+                net_emu_complete(key, status);
+                *index = i;
+                return err;
+            }
+        }
+    }
+    keys = net_emu_keys(count, array_of_requests);
+    err = PMPI_Waitany(count, array_of_requests, index, status);
+    if (*index != MPI_UNDEFINED){
+        net_round();
+        net_emu_complete(keys[*index], status);
+    }
+    free(keys);
+    return err;
+}
+
+int MPI_Waitsome(int incount, MPI_Request array_of_requests[], int *outcount, int array_of_indices[], MPI_Status array_of_statuses[]){
+    MPI_Status local, *status, *statuses = array_of_statuses;
+    unsigned long long key, *keys;
+    int i, active = 1, err = MPI_SUCCESS;
+    if (!net_tracking()){
+        return PMPI_Waitsome(incount, array_of_requests, outcount, array_of_indices, array_of_statuses);
+    }
+    *outcount = 0;
+    while (active && *outcount == 0 && net_emu_ppn){
+        active = 0;
+        for ( i = 0; i < incount; ++i ){
+            if (array_of_requests[i] == MPI_REQUEST_NULL){
+                continue;
+            }
+            active = 1;
+            status = array_of_statuses == MPI_STATUSES_IGNORE ? &local : array_of_statuses + *outcount;
+            if (net_emu_ready(array_of_requests[i], status)){
+                key = net_emu_key(array_of_requests + i, sizeof(MPI_Request));
+                err = PMPI_Wait(array_of_requests + i, status);
+                net_emu_complete(key, status);
+                array_of_indices[(*outcount)++] = i;
+            }
+        }
+    }
+    if (*outcount){
+        net_round();
+        return err;
+    }
+    keys = net_emu_keys(incount, array_of_requests);
+    if (statuses == MPI_STATUSES_IGNORE){
+        statuses = (MPI_Status*) malloc(sizeof(MPI_Status) * (incount + 1));
+    }
+    err = PMPI_Waitsome(incount, array_of_requests, outcount, array_of_indices, statuses);
+    if (*outcount != MPI_UNDEFINED && *outcount){
+        net_round();
+        for ( i = 0; i < *outcount; ++i ){
+            net_emu_complete(keys[array_of_indices[i]], statuses + i);
+        }
+    }
+    if (statuses != array_of_statuses){
+        free(statuses);
+    }
+    free(keys);
+    return err;
+}
+
+int MPI_Finalize(){
+    net_emulation_free();
+    return PMPI_Finalize();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2020, Northwestern University
+ * See COPYRIGHT notice in top-level directory.
+ *
+ * Schedules of the all-to-many methods, without MPI: where the aggregators are and which aggregators a process sends to in every communication
+ * window. mpi_test.c posts the messages of these schedules and simulator.c replays them at process counts that do not fit an allocation.
+ */
+
+/*
+ * Ranks of the cb_nodes aggregators of -t type, 0: the first cb_nodes ranks, 1: spread evenly, 2: spread evenly and shifted back by 16 ranks,
+ * 3: round-robin over the nodes of proc_node processes.
+*/
+int schedule_aggregators(int procs, int cb_nodes, int proc_node, int type, int *rank_list){
+    int i, remainder, ceiling, floor;
+    if (type == 1) {
+        remainder = procs / cb_nodes;
+        ceiling = (procs + cb_nodes - 1) / cb_nodes;
+        floor = procs / cb_nodes;
+        for ( i = 0; i < cb_nodes; ++i ){
+            if ( i < remainder ){
+                rank_list[i] = ceiling * i;
+            } else {
+                rank_list[i] = ceiling * remainder + floor * (i - remainder);
+            }
+        }
+    } else if (type == 0){
+        for ( i = 0; i < cb_nodes; ++i ){
+            rank_list[i] = i;
+        }
+    } else if (type == 2){
+        remainder = procs / cb_nodes;
+        ceiling = (procs + cb_nodes - 1) / cb_nodes;
+        floor = procs / cb_nodes;
+        for ( i = 0; i < cb_nodes; ++i ){
+            if ( i < remainder ){
+                rank_list[i] = (ceiling * i - 16 + procs * 16 ) % procs;
+            } else {
+                rank_list[i] = (ceiling * remainder + floor * (i - remainder) - 16 + procs * 16) % procs;
+            }
+        }
+    } else if (type == 3) {
+        remainder = 0;
+        for ( i = 0; i < cb_nodes; ++i ) {
+            rank_list[i] = remainder;
+            remainder += proc_node;
+            if ( remainder >= procs ){
+                remainder = remainder % proc_node + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Node-robin order of the ranks: map[i] is the rank at position i, the first rank of every node, then the second rank of every node and so on.
+*/
+int schedule_node_robin(int procs, int proc_node, int *map){
+    int i, j, count;
+    count = 0;
+    j = 0;
+    for ( i = 0; i < procs; ++i ){
+        map[i] = count;
+        count += proc_node;
+        if (count >= procs) {
+            j++;
+            count = j;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Balanced schedule: aggregator index receives from the procs / cb_nodes positions that start at its offset, shifted by the window start k.
+*/
+static int schedule_balanced_offset(int index, int procs, int cb_nodes){
+    int ceiling, floor, remainder;
+    ceiling = (procs + cb_nodes - 1) / cb_nodes;
+    floor = procs / cb_nodes;
+    remainder = procs % cb_nodes;
+    if (index < remainder) {
+        return index * ceiling;
+    }
+    return remainder * ceiling + (index - remainder) * floor;
+}
+
+/*
+ * The aggregator whose first window contains position rank, the first aggregator this position sends to.
+*/
+int schedule_balanced_start(int rank, int procs, int cb_nodes){
+    int ceiling, floor, remainder;
+    ceiling = (procs + cb_nodes - 1) / cb_nodes;
+    floor = procs / cb_nodes;
+    remainder = procs % cb_nodes;
+    if ( rank >= remainder * ceiling ){
+        return remainder + (rank - remainder * ceiling) / floor;
+    }
+    return rank / ceiling;
+}
+
+/*
+ * Position aggregator myindex receives from as the i-th message of the window that starts at k.
+*/
+int schedule_balanced_source(int myindex, int procs, int cb_nodes, int k, int i){
+    return (k + i + schedule_balanced_offset(myindex, procs, cb_nodes)) % procs;
+}
+
+/*
+ * Aggregator indices position rank sends to in the window of comm_size positions that starts at k, in posting order. send_start is the next
+ * aggregator of this position, it moves on with every message and carries over to the next window. Returns the number of targets.
+*/
+int schedule_balanced_sends(int rank, int procs, int cb_nodes, int k, int comm_size, int *send_start, int *targets){
+    int x, temp, n = 0;
+    for ( x = 0; x < cb_nodes; ++x ) {
+        temp = k + schedule_balanced_offset(send_start[0], procs, cb_nodes);
+        if ( (temp >= procs && temp + comm_size >= procs) || (temp < procs && temp + comm_size < procs) ){
+            if ( !(rank >= temp % procs && rank < (temp + comm_size) % procs) ) {
+                break;
+            }
+        } else{
+            if ( !(rank >= temp || rank < (temp + comm_size) % procs) ) {
+                break;
+            }
+        }
+        targets[n++] = send_start[0];
+        send_start[0] = (send_start[0] - 1 + cb_nodes) % cb_nodes;
+    }
+    return n;
+}
+
+/*
+ * Scattered schedule: in the window that starts at k a rank posts its messages to ranks rank - k - i, i < bblock, and receives from rank + k + i.
+ * The rank this rank receives from as the i-th message of the window that starts at k.
+*/
+int schedule_scattered_source(int rank, int procs, int k, int i){
+    return (rank + i + k) % procs;
+}
+
+/*
+ * The rank this rank sends to as the i-th message of the window that starts at k.
+*/
+int schedule_scattered_dest(int rank, int procs, int k, int i){
+    return (rank - i - k + procs) % procs;
+}
+
+/*
+ * The window in which rank sends to peer, the inverse of schedule_scattered_dest. It is the same window in which peer receives from rank.
+*/
+int schedule_scattered_window(int rank, int peer, int procs, int bblock){
+    return ((rank - peer + procs) % procs) / bblock;
+}
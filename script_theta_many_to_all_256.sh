@@ -30,77 +30,7 @@ echo "--------------------------------------------------"
 echo ""
 echo "---- KNL $RUN_CMMD ----"
 
-export RUN_OPTS="-a 256 -d 2048 -c 1 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 2 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 4 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 8 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 16 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 32 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 64 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 128 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 256 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 512 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 1024 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 2048 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 4096 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 8192 -m 2 -i 5"
-export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
-echo "command=$command"
-$command
-
-export RUN_OPTS="-a 256 -d 2048 -c 999999999 -m 2 -i 5"
+export RUN_OPTS="-a 256 -d 2048 -c 1:8192:x2,999999999 -m 2 -i 5"
 export command="aprun -n $NP -N $nprocs_per_node $KNL_OPTS ./$RUN_CMMD $RUN_OPTS"
 echo "command=$command"
 $command
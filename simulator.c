@@ -0,0 +1,646 @@
+/*
+ * Copyright (C) 2020, Northwestern University
+ * See COPYRIGHT notice in top-level directory.
+ *
+ * Discrete-event simulator of the all-to-many schedules of mpi_test.c, without MPI. The messages of the balanced, scattered and node-robin
+ * methods come from the same schedule functions (schedule.c) the MPI methods post, window by window. TAM is modelled by hand, see schedule_round. A process starts its next window once all messages of the current one are done, as
+ * MPI_Waitall does, and a message starts once both its sender and its receiver have reached its window, as MPI_Issend does.
+ * Network model: the NIC of every node is a queue for sending and one for receiving, a message between nodes takes bytes / bandwidth in the
+ * queue of the sending node and in the one of the receiving node and is done a latency after it has left both. A message inside a node takes
+ * the intra-node latency and bandwidth, without contention. A receiver takes at most incast messages at a time into the queues, the others
+ * wait for a slot.
+ */
+
+#include <unistd.h> /* getopt() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define SIM_DONE 0
+#define SIM_ROUND 1
+#define SIM_ALL_TO_MANY_BALANCED 3
+#define SIM_ALL_TO_MANY_SCATTERED 13
+#define SIM_ALL_TO_MANY_TAM 15
+#define SIM_ALL_TO_MANY_NODE_ROBIN 17
+
+typedef struct{
+    int method;
+    int procs;
+    int proc_node;
+    int nodes;
+    int cb_nodes;
+    int bblock;
+    int nrounds;
+    int barrier;
+    long long data_size;
+    int *rank_list;
+    /* Aggregator index of every rank, -1 if it is not an aggregator.*/
+    int *agg_index;
+    /* Node-robin position of every rank and rank of every position.*/
+    int *robin_index;
+    int *robin_map;
+    /* Next aggregator of the balanced schedule of every rank.*/
+    int *send_start;
+    /* Number of aggregators of every node (TAM).*/
+    int *node_aggs;
+    int *targets;
+}Sim_schedule;
+
+typedef struct{
+    /* Between nodes: seconds and bytes per second of the NIC of a node (0: unlimited).*/
+    double latency;
+    double bandwidth;
+    double intra_latency;
+    double intra_bandwidth;
+    /* Messages a receiver accepts at the same time, 0: unlimited.*/
+    int incast;
+}Sim_network;
+
+typedef struct{
+    int src;
+    int dst;
+    int round;
+    /* Next message parked at the same receiver, or next free message.*/
+    int next;
+    long long bytes;
+}Sim_message;
+
+typedef struct{
+    double time;
+    int type;
+    int id;
+    int round;
+}Sim_event;
+
+typedef struct{
+    Sim_schedule *sc;
+    Sim_network *net;
+    /* Window every rank is in, -1 before the first one, and its messages that are not done yet.*/
+    int *round;
+    int *pending;
+    /* First message that waits for its receiver to reach its window.*/
+    int *parked;
+    /* Messages matched at every receiver, the ones of them in the NIC queues, and the first and last one that waits for a slot.*/
+    int *fanin;
+    int *active;
+    int *waiting;
+    int *waiting_tail;
+    /* Time at which the send and the receive queue of the NIC of every node are empty.*/
+    double *inj;
+    double *ej;
+    Sim_message *messages;
+    int nmessages;
+    int free_message;
+    Sim_event *heap;
+    int heap_size;
+    int heap_capacity;
+    int *dst;
+    long long *bytes;
+    int barrier_count;
+    double barrier_time;
+    int done_ranks;
+    double finish;
+    long long total_messages;
+    long long total_bytes;
+    int peak_fanin;
+    int peak_rank;
+    int error;
+}Sim_state;
+
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [OPTION]...\n"
+    "       [-h] Print help\n"
+    "       [-n] number of processes (default 1024)\n"
+    "       [-p] number of processes per node (default 64)\n"
+    "       [-a] number of aggregators (default 16)\n"
+    "       [-t] aggregator placement, as -t of mpi_test (default 1)\n"
+    "       [-d] data size of every process and aggregator pair (default 1048576)\n"
+    "       [-c] maximum communication size, processes per window (default: all)\n"
+    "       [-b] 2: method 13 synchronizes after every window, as -b of mpi_test, 0: off (default)\n"
+    "       [-m] method, the numbers of mpi_test\n"
+    "           0: All simulated methods (default)\n"
+    "           3: All to many with ordering (all-to-many balanced)\n"
+    "           13: All to many scattered (all-to-many scattered)\n"
+    "           15: All to many through a proxy per node (all-to-many TAM)\n"
+    "           17: All to many with ordering over node-robin positions (all-to-many node robin)\n"
+    "       [-E] network between nodes, latency in microseconds,NIC bandwidth per node in MiB/s (0: unlimited) (default 2,10000)\n"
+    "       [-I] network inside a node, latency in microseconds,bandwidth per message in MiB/s (0: unlimited) (default 0.5,0)\n"
+    "       [-F] messages a receiver accepts at the same time, 0: unlimited (default)\n"
+    ;
+    fprintf(stderr, help, argv0);
+}
+
+extern int schedule_aggregators(int procs, int cb_nodes, int proc_node, int type, int *rank_list);
+
+extern int schedule_node_robin(int procs, int proc_node, int *map);
+
+extern int schedule_balanced_start(int rank, int procs, int cb_nodes);
+
+extern int schedule_balanced_source(int myindex, int procs, int cb_nodes, int k, int i);
+
+extern int schedule_balanced_sends(int rank, int procs, int cb_nodes, int k, int comm_size, int *send_start, int *targets);
+
+extern int schedule_scattered_source(int rank, int procs, int k, int i);
+
+extern int schedule_scattered_window(int rank, int peer, int procs, int bblock);
+
+static int node_size(Sim_schedule *sc, int node){
+    return node < sc->nodes - 1 ? sc->proc_node : sc->procs - sc->proc_node * (sc->nodes - 1);
+}
+
+int schedule_setup(Sim_schedule *sc, int method, int procs, int proc_node, int cb_nodes, int aggregator_type, int comm_size, int barrier_type, long long data_size){
+    int i;
+    sc->method = method;
+    sc->procs = procs;
+    sc->proc_node = proc_node;
+    sc->nodes = (procs + proc_node - 1) / proc_node;
+    sc->cb_nodes = cb_nodes;
+    sc->data_size = data_size;
+    if (comm_size > procs || comm_size <= 0){
+        comm_size = procs;
+    }
+    sc->bblock = comm_size;
+    sc->nrounds = (procs + comm_size - 1) / comm_size;
+    sc->barrier = method == SIM_ALL_TO_MANY_NODE_ROBIN || (method == SIM_ALL_TO_MANY_SCATTERED && barrier_type == 2);
+    if (method == SIM_ALL_TO_MANY_TAM){
+        sc->nrounds = 3;
+    }
+    sc->rank_list = (int*) malloc(sizeof(int) * cb_nodes);
+    sc->agg_index = (int*) malloc(sizeof(int) * procs);
+    sc->robin_index = (int*) malloc(sizeof(int) * procs);
+    sc->robin_map = (int*) malloc(sizeof(int) * procs);
+    sc->send_start = (int*) malloc(sizeof(int) * procs);
+    sc->node_aggs = (int*) calloc(sc->nodes, sizeof(int));
+    sc->targets = (int*) malloc(sizeof(int) * cb_nodes);
+    schedule_aggregators(procs, cb_nodes, proc_node, aggregator_type, sc->rank_list);
+    schedule_node_robin(procs, proc_node, sc->robin_map);
+    for ( i = 0; i < procs; ++i ){
+        sc->agg_index[i] = -1;
+        sc->robin_index[sc->robin_map[i]] = i;
+    }
+    for ( i = 0; i < cb_nodes; ++i ){
+        sc->agg_index[sc->rank_list[i]] = i;
+        sc->node_aggs[sc->rank_list[i] / proc_node]++;
+    }
+    for ( i = 0; i < procs; ++i ){
+        sc->send_start[i] = schedule_balanced_start(method == SIM_ALL_TO_MANY_NODE_ROBIN ? sc->robin_index[i] : i, procs, cb_nodes);
+    }
+    return 0;
+}
+
+int schedule_clean(Sim_schedule *sc){
+    free(sc->rank_list);
+    free(sc->agg_index);
+    free(sc->robin_index);
+    free(sc->robin_map);
+    free(sc->send_start);
+    free(sc->node_aggs);
+    free(sc->targets);
+    return 0;
+}
+
+/*
+ * Messages rank posts in window round: the destinations and sizes of its sends, and the number of messages it receives. Self messages are local
+ * copies and not counted. The windows of a method must be entered in order, the balanced schedules keep their state between windows.
+*/
+static int schedule_round(Sim_schedule *sc, int rank, int round, int *dst, long long *bytes, int *nrecvs){
+    int i, n, k, size, src, agg, node, ns = 0;
+    nrecvs[0] = 0;
+    agg = sc->agg_index[rank];
+    if (sc->method == SIM_ALL_TO_MANY_BALANCED || sc->method == SIM_ALL_TO_MANY_NODE_ROBIN){
+        k = round * sc->bblock;
+        size = sc->procs - k < sc->bblock ? sc->procs - k : sc->bblock;
+        n = schedule_balanced_sends(sc->method == SIM_ALL_TO_MANY_NODE_ROBIN ? sc->robin_index[rank] : rank, sc->procs, sc->cb_nodes, k, size, sc->send_start + rank, sc->targets);
+        for ( i = 0; i < n; ++i ){
+            if (sc->rank_list[sc->targets[i]] != rank){
+                dst[ns] = sc->rank_list[sc->targets[i]];
+                bytes[ns++] = sc->data_size;
+            }
+        }
+        if (agg >= 0){
+            for ( i = 0; i < size; ++i ){
+                src = schedule_balanced_source(agg, sc->procs, sc->cb_nodes, k, i);
+                if (sc->method == SIM_ALL_TO_MANY_NODE_ROBIN){
+                    src = sc->robin_map[src];
+                }
+                if (src != rank){
+                    nrecvs[0]++;
+                }
+            }
+        }
+    } else if (sc->method == SIM_ALL_TO_MANY_SCATTERED){
+        for ( i = 0; i < sc->cb_nodes; ++i ){
+            if (sc->rank_list[i] != rank && schedule_scattered_window(rank, sc->rank_list[i], sc->procs, sc->bblock) == round){
+                dst[ns] = sc->rank_list[i];
+                bytes[ns++] = sc->data_size;
+            }
+        }
+        if (agg >= 0){
+            k = round * sc->bblock;
+            size = sc->procs - k < sc->bblock ? sc->procs - k : sc->bblock;
+            for ( i = 0; i < size; ++i ){
+                if (schedule_scattered_source(rank, sc->procs, k, i) != rank){
+                    nrecvs[0]++;
+                }
+            }
+        }
+    } else if (sc->method == SIM_ALL_TO_MANY_TAM){
+        /*
+         * TAM has no schedule function, collective_write of lustre_driver_test.c builds its messages at run time. Its three stages are modelled
+         * here by hand: block node assignment of static_node_assignment without -N, the first rank of a node is its proxy. The size exchange and
+         * the copies of the proxies are not simulated.
+        */
+        node = rank / sc->proc_node;
+        if (round == 0){
+            if (rank != node * sc->proc_node){
+                dst[ns] = node * sc->proc_node;
+                bytes[ns++] = sc->data_size * sc->cb_nodes;
+            } else {
+                nrecvs[0] = node_size(sc, node) - 1;
+            }
+        } else if (round == 1 && rank == node * sc->proc_node){
+            for ( i = 0; i < sc->nodes; ++i ){
+                if (i != node && sc->node_aggs[i]){
+                    dst[ns] = i * sc->proc_node;
+                    bytes[ns++] = sc->data_size * node_size(sc, node) * sc->node_aggs[i];
+                }
+            }
+            nrecvs[0] = sc->node_aggs[node] ? sc->nodes - 1 : 0;
+        } else if (round == 2){
+            if (rank == node * sc->proc_node){
+                for ( i = 0; i < sc->cb_nodes; ++i ){
+                    if (sc->rank_list[i] / sc->proc_node == node && sc->rank_list[i] != rank){
+                        dst[ns] = sc->rank_list[i];
+                        bytes[ns++] = sc->data_size * sc->procs;
+                    }
+                }
+            } else if (agg >= 0){
+                nrecvs[0] = 1;
+            }
+        }
+    }
+    return ns;
+}
+
+static int heap_push(Sim_state *st, double time, int type, int id, int round){
+    Sim_event e, *h;
+    int i, parent;
+    if (st->heap_size == st->heap_capacity){
+        st->heap_capacity = st->heap_capacity ? st->heap_capacity * 2 : 1024;
+        st->heap = (Sim_event*) realloc(st->heap, sizeof(Sim_event) * st->heap_capacity);
+    }
+    h = st->heap;
+    e.time = time;
+    e.type = type;
+    e.id = id;
+    e.round = round;
+    /* Messages that are done at the same time free their slots before any process moves on.*/
+    for ( i = st->heap_size++; i > 0; i = parent ){
+        parent = (i - 1) / 2;
+        if (h[parent].time < e.time || (h[parent].time == e.time && h[parent].type <= e.type)){
+            break;
+        }
+        h[i] = h[parent];
+    }
+    h[i] = e;
+    return 0;
+}
+
+static Sim_event heap_pop(Sim_state *st){
+    Sim_event top, last, *h = st->heap;
+    int i, child;
+    top = h[0];
+    last = h[--st->heap_size];
+    for ( i = 0; 2 * i + 1 < st->heap_size; i = child ){
+        child = 2 * i + 1;
+        if (child + 1 < st->heap_size && (h[child + 1].time < h[child].time || (h[child + 1].time == h[child].time && h[child + 1].type < h[child].type))){
+            child++;
+        }
+        if (last.time < h[child].time || (last.time == h[child].time && last.type <= h[child].type)){
+            break;
+        }
+        h[i] = h[child];
+    }
+    h[i] = last;
+    return top;
+}
+
+static int message_new(Sim_state *st, int src, int dst, long long bytes, int round){
+    int id;
+    if (st->free_message < 0){
+        st->messages = (Sim_message*) realloc(st->messages, sizeof(Sim_message) * (st->nmessages ? st->nmessages * 2 : 1024));
+        for ( id = st->nmessages ? st->nmessages * 2 - 1 : 1023; id >= st->nmessages; --id ){
+            st->messages[id].next = st->free_message;
+            st->free_message = id;
+        }
+        st->nmessages = st->nmessages ? st->nmessages * 2 : 1024;
+    }
+    id = st->free_message;
+    st->free_message = st->messages[id].next;
+    st->messages[id].src = src;
+    st->messages[id].dst = dst;
+    st->messages[id].bytes = bytes;
+    st->messages[id].round = round;
+    st->messages[id].next = -1;
+    return id;
+}
+
+/*
+ * Message id has a receive slot at time now, it takes its place in the NIC queues and is done once it has left both.
+*/
+static int message_start(Sim_state *st, int id, double now){
+    Sim_message *m = st->messages + id;
+    Sim_network *net = st->net;
+    double finish, xfer;
+    int src_node, dst_node;
+    st->active[m->dst]++;
+    src_node = m->src / st->sc->proc_node;
+    dst_node = m->dst / st->sc->proc_node;
+    if (src_node != dst_node){
+        xfer = net->bandwidth > 0 ? m->bytes / net->bandwidth : 0;
+        st->inj[src_node] = (st->inj[src_node] > now ? st->inj[src_node] : now) + xfer;
+        st->ej[dst_node] = (st->ej[dst_node] > now ? st->ej[dst_node] : now) + xfer;
+        finish = (st->inj[src_node] > st->ej[dst_node] ? st->inj[src_node] : st->ej[dst_node]) + net->latency;
+    } else {
+        finish = now + net->intra_latency + (net->intra_bandwidth > 0 ? m->bytes / net->intra_bandwidth : 0);
+    }
+    heap_push(st, finish, SIM_DONE, id, m->round);
+    return 0;
+}
+
+/*
+ * Both ends of message id have reached its window at time now. It starts at once if its receiver has a free slot, otherwise it waits for one.
+*/
+static int message_match(Sim_state *st, int id, double now){
+    Sim_message *m = st->messages + id;
+    st->fanin[m->dst]++;
+    if (st->fanin[m->dst] > st->peak_fanin){
+        st->peak_fanin = st->fanin[m->dst];
+        st->peak_rank = m->dst;
+    }
+    st->total_messages++;
+    st->total_bytes += m->bytes;
+    if (st->net->incast && st->active[m->dst] >= st->net->incast){
+        m->next = -1;
+        if (st->waiting[m->dst] < 0){
+            st->waiting[m->dst] = id;
+        } else {
+            st->messages[st->waiting_tail[m->dst]].next = id;
+        }
+        st->waiting_tail[m->dst] = id;
+        return 0;
+    }
+    return message_start(st, id, now);
+}
+
+static int round_done(Sim_state *st, int rank, double now){
+    int i;
+    if (!st->sc->barrier){
+        heap_push(st, now, SIM_ROUND, rank, st->round[rank] + 1);
+        return 0;
+    }
+    /* Dissemination barrier of every window.*/
+    if (now > st->barrier_time){
+        st->barrier_time = now;
+    }
+    if (++st->barrier_count == st->sc->procs){
+        st->barrier_count = 0;
+        st->barrier_time += ceil(log2(st->sc->procs)) * st->net->latency;
+        for ( i = 0; i < st->sc->procs; ++i ){
+            heap_push(st, st->barrier_time, SIM_ROUND, i, st->round[i] + 1);
+        }
+    }
+    return 0;
+}
+
+/*
+ * rank enters window round at time now: its sends start if their receiver is in the same window, otherwise they wait for it, and the messages
+ * that waited for rank start. Without barriers windows in which rank has nothing to do are skipped.
+*/
+static int round_enter(Sim_state *st, int rank, int round, double now){
+    Sim_schedule *sc = st->sc;
+    int i, n = 0, nrecvs = 0, id, *prev;
+    for ( ; round < sc->nrounds; ++round ){
+        n = schedule_round(sc, rank, round, st->dst, st->bytes, &nrecvs);
+        if (n || nrecvs || sc->barrier){
+            break;
+        }
+    }
+    if (round >= sc->nrounds){
+        st->round[rank] = sc->nrounds;
+        st->done_ranks++;
+        if (now > st->finish){
+            st->finish = now;
+        }
+        return 0;
+    }
+    st->round[rank] = round;
+    st->pending[rank] = n + nrecvs;
+    for ( i = 0; i < n; ++i ){
+        id = message_new(st, rank, st->dst[i], st->bytes[i], round);
+        if (st->round[st->dst[i]] == round){
+            message_match(st, id, now);
+        } else if (st->round[st->dst[i]] < round){
+            st->messages[id].next = st->parked[st->dst[i]];
+            st->parked[st->dst[i]] = id;
+        } else {
+            st->error = 1;
+        }
+    }
+    for ( prev = st->parked + rank; prev[0] >= 0; ){
+        id = prev[0];
+        if (st->messages[id].round == round){
+            prev[0] = st->messages[id].next;
+            message_match(st, id, now);
+        } else {
+            prev = &(st->messages[id].next);
+        }
+    }
+    if (st->pending[rank] == 0){
+        round_done(st, rank, now);
+    }
+    return 0;
+}
+
+static int message_done(Sim_state *st, int id, double now){
+    Sim_message *m = st->messages + id;
+    int src = m->src, dst = m->dst;
+    st->fanin[dst]--;
+    st->active[dst]--;
+    m->next = st->free_message;
+    st->free_message = id;
+    if (st->waiting[dst] >= 0){
+        id = st->waiting[dst];
+        st->waiting[dst] = st->messages[id].next;
+        message_start(st, id, now);
+    }
+    if (--st->pending[src] == 0){
+        round_done(st, src, now);
+    }
+    if (--st->pending[dst] == 0){
+        round_done(st, dst, now);
+    }
+    return 0;
+}
+
+int simulate(Sim_schedule *sc, Sim_network *net, Sim_state *st){
+    Sim_event e;
+    int i, capacity;
+    st->sc = sc;
+    st->net = net;
+    st->round = (int*) malloc(sizeof(int) * sc->procs);
+    st->pending = (int*) calloc(sc->procs, sizeof(int));
+    st->parked = (int*) malloc(sizeof(int) * sc->procs);
+    st->fanin = (int*) calloc(sc->procs, sizeof(int));
+    st->active = (int*) calloc(sc->procs, sizeof(int));
+    st->waiting = (int*) malloc(sizeof(int) * sc->procs);
+    st->waiting_tail = (int*) malloc(sizeof(int) * sc->procs);
+    st->inj = (double*) calloc(sc->nodes, sizeof(double));
+    st->ej = (double*) calloc(sc->nodes, sizeof(double));
+    capacity = sc->cb_nodes > sc->nodes ? sc->cb_nodes : sc->nodes;
+    st->dst = (int*) malloc(sizeof(int) * capacity);
+    st->bytes = (long long*) malloc(sizeof(long long) * capacity);
+    st->messages = NULL;
+    st->nmessages = 0;
+    st->free_message = -1;
+    st->heap = NULL;
+    st->heap_size = 0;
+    st->heap_capacity = 0;
+    st->barrier_count = 0;
+    st->barrier_time = 0;
+    st->done_ranks = 0;
+    st->finish = 0;
+    st->total_messages = 0;
+    st->total_bytes = 0;
+    st->peak_fanin = 0;
+    st->peak_rank = 0;
+    st->error = 0;
+    for ( i = 0; i < sc->procs; ++i ){
+        st->round[i] = -1;
+        st->parked[i] = -1;
+        st->waiting[i] = -1;
+    }
+    for ( i = 0; i < sc->procs; ++i ){
+        round_enter(st, i, 0, 0);
+    }
+    while (st->heap_size && !st->error){
+        e = heap_pop(st);
+        if (e.type == SIM_DONE){
+            message_done(st, e.id, e.time);
+        } else {
+            round_enter(st, e.id, e.round, e.time);
+        }
+    }
+    /* A message for a window its receiver has left, or processes left waiting, means the two sides of the schedule disagree.*/
+    if (st->done_ranks != sc->procs){
+        st->error = 1;
+    }
+    free(st->round);
+    free(st->pending);
+    free(st->parked);
+    free(st->fanin);
+    free(st->active);
+    free(st->waiting);
+    free(st->waiting_tail);
+    free(st->inj);
+    free(st->ej);
+    free(st->dst);
+    free(st->bytes);
+    free(st->messages);
+    free(st->heap);
+    return st->error;
+}
+
+int report_simulation(char *name, Sim_schedule *sc, Sim_state *st){
+    printf("| --------------------------------------\n");
+    if (st->error){
+        printf("| %s schedule did not complete, its senders and receivers disagree\n", name);
+        return 1;
+    }
+    printf("| %s predicted time = %lf\n", name, st->finish);
+    printf("| %s messages = %lld, bytes = %lld, windows = %d\n", name, st->total_messages, st->total_bytes, sc->nrounds);
+    printf("| %s peak receiver fan-in = %d (rank %d)\n", name, st->peak_fanin, st->peak_rank);
+    return 0;
+}
+
+int main(int argc, char **argv){
+    int procs = 1024, proc_node = 64, cb_nodes = 16, aggregator_type = 1, comm_size = 0, barrier_type = 0, method = 0, bad_option = 0, i, m;
+    int methods[4] = {SIM_ALL_TO_MANY_BALANCED, SIM_ALL_TO_MANY_SCATTERED, SIM_ALL_TO_MANY_TAM, SIM_ALL_TO_MANY_NODE_ROBIN};
+    char *names[4] = {"All to many balanced", "All to many scattered", "All to many TAM", "All to many node robin"};
+    long long data_size = 1048576;
+    Sim_network net = {2e-6, 10000.0 * 1048576, 5e-7, 0, 0};
+    Sim_schedule sc;
+    Sim_state st;
+    int err = 0;
+
+    while ((i = getopt(argc, argv, "hn:p:a:t:d:c:b:m:E:I:F:")) != EOF){
+        switch(i) {
+            case 'n':
+                procs = atoi(optarg);
+                break;
+            case 'p':
+                proc_node = atoi(optarg);
+                break;
+            case 'a':
+                cb_nodes = atoi(optarg);
+                break;
+            case 't':
+                aggregator_type = atoi(optarg);
+                break;
+            case 'd':
+                data_size = atoll(optarg);
+                break;
+            case 'c':
+                comm_size = atoi(optarg);
+                break;
+            case 'b':
+                barrier_type = atoi(optarg);
+                break;
+            case 'm':
+                method = atoi(optarg);
+                break;
+            case 'E':
+                if (sscanf(optarg, "%lf,%lf", &net.latency, &net.bandwidth) < 1 || net.latency < 0 || net.bandwidth < 0){
+                    bad_option = 1;
+                }
+                net.latency /= 1000000;
+                net.bandwidth *= 1048576;
+                break;
+            case 'I':
+                if (sscanf(optarg, "%lf,%lf", &net.intra_latency, &net.intra_bandwidth) < 1 || net.intra_latency < 0 || net.intra_bandwidth < 0){
+                    bad_option = 1;
+                }
+                net.intra_latency /= 1000000;
+                net.intra_bandwidth *= 1048576;
+                break;
+            case 'F':
+                net.incast = atoi(optarg);
+                break;
+            default:
+                bad_option = 1;
+                break;
+        }
+    }
+    if (procs < 1 || proc_node < 1 || cb_nodes < 1 || cb_nodes > procs || net.incast < 0 || bad_option){
+        usage(argv[0]);
+        return 1;
+    }
+    if (proc_node > procs){
+        proc_node = procs;
+    }
+    printf("simulated processes = %d, proc_node = %d, cb_nodes = %d, aggregator type = %d, data size = %lld, comm_size = %d\n", procs, proc_node, cb_nodes, aggregator_type, data_size, comm_size ? comm_size : procs);
+    printf("latency = %e, NIC bandwidth = %e, intra-node latency = %e, intra-node bandwidth = %e, incast limit = %d\n", net.latency, net.bandwidth, net.intra_latency, net.intra_bandwidth, net.incast);
+    for ( m = 0; m < 4; ++m ){
+        if (method && method != methods[m]){
+            continue;
+        }
+        schedule_setup(&sc, methods[m], procs, proc_node, cb_nodes, aggregator_type, comm_size, barrier_type, data_size);
+        simulate(&sc, &net, &st);
+        err |= report_simulation(names[m], &sc, &st);
+        schedule_clean(&sc);
+    }
+    return err;
+}
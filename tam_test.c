@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2019, Northwestern University
+ * See COPYRIGHT notice in top-level directory.
+ *
+ * This program runs the three-phase communication methods of lustre_driver_test.c (direct, TAM, local aggregators and shared-memory local
+ * aggregators) over every OST layout, rank assignment and number of local aggregators, and checks every result with test_correctness.
+ */
+
+#include <mpi.h>
+#include <unistd.h> /* getopt() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "benchmark.h"
+
+#define OST_STRIPE_SAME 0
+#define OST_STRIPE_MODEL 4
+#define ACCESS_CONTIGUOUS 0
+
+/* Settings shared by all combinations of one run.*/
+typedef struct{
+    int nprocs_node;
+    int blocklen;
+    int ntimes;
+    Stripe_model model;
+}Test_setting;
+
+extern double tam_injection_bandwidth;
+
+extern double tam_nic_bandwidth;
+
+extern int static_node_assignment(int rank, int nprocs, int type, int *nprocs_node,int *nrecvs, int** node_size, int** local_ranks, int** global_receivers, int **process_node_list);
+
+extern int initialize_setting(int rank, int nprocs, int *local_ranks, int *global_receivers, int nrecvs, int blocklen, int **recv_size, int **send_size, char ***recv_buf, char ***send_buf, int** global_aggregators, int *global_aggregator_size, int* is_aggregator, int type, Stripe_model *model);
+
+extern int clean_up(int nprocs, int **recv_size, int **send_size, char ***recv_buf, char ***send_buf);
+
+extern int test_correctness(int rank, int nprocs, int* recv_size, char **recv_buf);
+
+extern int aggregator_meta_information(int rank, int *process_node_list, int nprocs, int nrecvs, int global_aggregator_size, int *global_aggregators, int co, int *co_node, int* is_aggregator_new, int* local_aggregator_size, int **local_aggregators, int* nprocs_aggregator, int **aggregator_local_ranks, int **process_aggregator_list, int mode);
+
+extern int auto_local_aggregators(int rank, int nprocs, int nrecvs, int *process_node_list, int *send_size, MPI_Comm comm, int **co_node);
+
+extern int clean_aggregator_meta(int is_aggregator, int* aggregator_local_ranks, int* global_aggregators, int *process_aggregator_list);
+
+extern int create_recv_type(int nprocs, char** recv_buf, int* recv_size, int* local_aggregators, int local_aggregator_size, int *process_aggregator_list, MPI_Datatype** new_types);
+
+extern int clean_recv_type(int local_aggregator_size, MPI_Datatype* new_types);
+
+extern double net_emu_latency;
+
+extern double net_emu_bandwidth;
+
+extern int net_emulation_init(int ppn);
+
+extern int collective_write(int myrank, int nprocs, int nprocs_node, int nrecvs, int* local_ranks, int* global_receivers, int *process_node_list, int *recv_size, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm, Timer *timer);
+
+extern int collective_write2(int myrank, int nprocs, int nprocs_aggregator, int global_aggregator_size, int local_aggregator_size, int is_global_aggregator, int is_local_aggregator, int* aggregator_local_ranks, int* global_aggregators, int* local_aggregators, int *process_aggregator_list, int *recv_size, int *send_size, MPI_Datatype *recv_types, char **send_buf, int iter, MPI_Comm comm);
+
+extern int collective_write3(int myrank, int nprocs, int local_aggregator_size, int is_aggregator, int* local_aggregators, int *process_aggregator_list, int *recv_size, int *send_size, MPI_Datatype *recv_types, char **send_buf, int iter, MPI_Info win_info, MPI_Comm intra_comm, MPI_Comm comm);
+
+extern int collective_write_benchmark(int myrank, int nprocs, int *recv_size, int *send_size, char **recv_buf, char **send_buf, int iter, MPI_Comm comm);
+
+/*----< usage() >------------------------------------------------------------*/
+static void
+usage(char *argv0)
+{
+    char *help =
+    "Usage: %s [OPTION]...\n"
+    "       [-h] Print help\n"
+    "       [-p] number of MPI processes per node\n"
+    "       [-b] message block unit size\n"
+    "       [-n] number of iterations per combination (default 1)\n"
+    "       [-t] test type (0-4, 4 is the stripe model, default -1: all)\n"
+    "       [-r] rank assignment (0: block, 1: round-robin, default -1: both)\n"
+    "       [-c] largest number of local aggregators per node, co runs 0 (chosen per node) and 1, 2, 4, ... up to it (default -p)\n"
+    "       [-s] stripe size of the stripe model\n"
+    "       [-k] stripe count of the stripe model\n"
+    "       [-x] access pattern of the stripe model (0: contiguous, 1: strided, 2: block-cyclic)\n"
+    "       [-y] number of blocks per process of the stripe model\n"
+    "       [-g] blocks per cycle of the block-cyclic pattern\n"
+    "       [-j] injection bandwidth per process in MiB/s for co 0 (default: measured)\n"
+    "       [-l] injection bandwidth per node in MiB/s for co 0 (default: measured)\n"
+    "       [-E] emulate a network between the -p nodes of one host, latency in microseconds,bandwidth per node in MiB/s (0: unlimited), e.g. 2,10000\n";
+    fprintf(stderr, help, argv0);
+}
+
+/* Zero the receive buffers, so a method that leaves them untouched fails the check.*/
+static int reset_recv_buf(int nprocs, int *recv_size, char **recv_buf){
+    int i;
+    for ( i = 0; i < nprocs; i++ ){
+        if (recv_size[i]){
+            memset(recv_buf[i], 0, recv_size[i]);
+        }
+    }
+    return 0;
+}
+
+/* Print one row: method, test type, rank assignment, co (-1: not used), max time over all processes and the verdict of test_correctness on every process.*/
+static int report_row(int rank, const char *method, int type, int rank_assignment, int co, double time, int nprocs, int *recv_size, char **recv_buf, MPI_Comm comm){
+    double max_time;
+    int correct, all_correct;
+    correct = test_correctness(rank, nprocs, recv_size, recv_buf);
+    MPI_Allreduce(&correct, &all_correct, 1, MPI_INT, MPI_MIN, comm);
+    MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if ( rank == 0 ){
+        if ( co < 0 ){
+            printf("| %-6s | %4d | %10d | %4s | %12.6f | %s\n", method, type, rank_assignment, "-", max_time, all_correct ? "ok" : "FAILED");
+        } else {
+            printf("| %-6s | %4d | %10d | %4d | %12.6f | %s\n", method, type, rank_assignment, co, max_time, all_correct ? "ok" : "FAILED");
+        }
+    }
+    return !all_correct;
+}
+
+/*
+  Run collective_write2 (tam2) and collective_write3 (tam3) with co local aggregators per node (co = 0: chosen per node by auto_local_aggregators).
+  collective_write3 gathers through a shared-memory window and only the local aggregators receive, so it is skipped when a group of a local
+  aggregator does not share memory or when co is too small for every global aggregator to be a local aggregator.
+*/
+static int run_local_aggregators(int rank, int nprocs, int type, int rank_assignment, int co, int nrecvs, int *process_node_list, int global_aggregator_size, int *global_aggregators, int is_aggregator, int *recv_size, int *send_size, char **recv_buf, char **send_buf, Test_setting *setting, MPI_Comm comm){
+    int *local_aggregators, *aggregator_local_ranks = NULL, *process_aggregator_list, *co_node = NULL;
+    int is_aggregator_new, local_aggregator_size, nprocs_aggregator, group_size, shared_size, shared, covered, i, j, m, failures = 0;
+    MPI_Datatype *recv_types;
+    MPI_Comm intra_comm, shared_comm;
+    MPI_Info win_info;
+    double start;
+    if ( co == 0 ){
+        auto_local_aggregators(rank, nprocs, nrecvs, process_node_list, send_size, comm, &co_node);
+    }
+    aggregator_meta_information(rank, process_node_list, nprocs, nrecvs, global_aggregator_size, global_aggregators, co, co_node, &is_aggregator_new, &local_aggregator_size, &local_aggregators, &nprocs_aggregator, &aggregator_local_ranks, &process_aggregator_list, 1);
+    create_recv_type(nprocs, recv_buf, recv_size, local_aggregators, local_aggregator_size, process_aggregator_list, &recv_types);
+
+    reset_recv_buf(nprocs, recv_size, recv_buf);
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for ( m = 0; m < setting->ntimes; m++ ){
+        collective_write2(rank, nprocs, nprocs_aggregator, global_aggregator_size, local_aggregator_size, is_aggregator, is_aggregator_new, aggregator_local_ranks, global_aggregators, local_aggregators, process_aggregator_list, recv_size, send_size, recv_types, send_buf, m, comm);
+    }
+    failures += report_row(rank, "tam2", type, rank_assignment, co, MPI_Wtime() - start, nprocs, recv_size, recv_buf, comm);
+
+    /* Group ranks are ordered like the senders in recv_types.*/
+    MPI_Comm_split(comm, process_aggregator_list[rank], rank, &intra_comm);
+    MPI_Comm_split_type(intra_comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &shared_comm);
+    MPI_Comm_size(intra_comm, &group_size);
+    MPI_Comm_size(shared_comm, &shared_size);
+    MPI_Comm_free(&shared_comm);
+    shared = group_size == shared_size;
+    MPI_Allreduce(MPI_IN_PLACE, &shared, 1, MPI_INT, MPI_MIN, comm);
+    covered = 1;
+    for ( i = 0; i < global_aggregator_size && covered; i++ ){
+        for ( j = 0; j < local_aggregator_size && local_aggregators[j] != global_aggregators[i]; j++ );
+        covered = j < local_aggregator_size;
+    }
+    if (!covered){
+        if ( rank == 0 ){
+            printf("| %-6s | %4d | %10d | %4d | %12s | skipped, global aggregators outside the local aggregators\n", "tam3", type, rank_assignment, co, "-");
+        }
+    } else if (shared){
+        MPI_Info_create(&win_info);
+        MPI_Info_set(win_info, "alloc_shared_contig", "true");
+        reset_recv_buf(nprocs, recv_size, recv_buf);
+        MPI_Barrier(comm);
+        start = MPI_Wtime();
+        for ( m = 0; m < setting->ntimes; m++ ){
+            collective_write3(rank, nprocs, local_aggregator_size, is_aggregator_new, local_aggregators, process_aggregator_list, recv_size, send_size, recv_types, send_buf, m, win_info, intra_comm, comm);
+        }
+        failures += report_row(rank, "tam3", type, rank_assignment, co, MPI_Wtime() - start, nprocs, recv_size, recv_buf, comm);
+        MPI_Info_free(&win_info);
+    } else if ( rank == 0 ){
+        printf("| %-6s | %4d | %10d | %4d | %12s | skipped, groups span shared-memory nodes\n", "tam3", type, rank_assignment, co, "-");
+    }
+    MPI_Comm_free(&intra_comm);
+
+    clean_recv_type(local_aggregator_size, recv_types);
+    clean_aggregator_meta(is_aggregator_new, aggregator_local_ranks, local_aggregators, process_aggregator_list);
+    if ( co_node != NULL ){
+        free(co_node);
+    }
+    return failures;
+}
+
+/* All methods and co values for one test type and rank assignment. comm is private to the rank assignment (TAM caches its communicators on it).*/
+static int run_type(int rank, int nprocs, int type, int rank_assignment, int max_co, int nprocs_node, int nrecvs, int *local_ranks, int *global_receivers, int *process_node_list, Test_setting *setting, MPI_Comm comm){
+    int *recv_size, *send_size, *global_aggregators, global_aggregator_size, is_aggregator, co, m, failures = 0;
+    char **recv_buf, **send_buf;
+    Timer timer;
+    double start;
+    initialize_setting(rank, nprocs, local_ranks, global_receivers, nrecvs, setting->blocklen, &recv_size, &send_size, &recv_buf, &send_buf, &global_aggregators, &global_aggregator_size, &is_aggregator, type, &setting->model);
+
+    reset_recv_buf(nprocs, recv_size, recv_buf);
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for ( m = 0; m < setting->ntimes; m++ ){
+        collective_write_benchmark(rank, nprocs, recv_size, send_size, recv_buf, send_buf, m, comm);
+    }
+    failures += report_row(rank, "direct", type, rank_assignment, -1, MPI_Wtime() - start, nprocs, recv_size, recv_buf, comm);
+
+    memset(&timer, 0, sizeof(Timer));
+    reset_recv_buf(nprocs, recv_size, recv_buf);
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    for ( m = 0; m < setting->ntimes; m++ ){
+        collective_write(rank, nprocs, nprocs_node, nrecvs, local_ranks, global_receivers, process_node_list, recv_size, send_size, recv_buf, send_buf, m, comm, &timer);
+    }
+    failures += report_row(rank, "tam", type, rank_assignment, -1, MPI_Wtime() - start, nprocs, recv_size, recv_buf, comm);
+
+    failures += run_local_aggregators(rank, nprocs, type, rank_assignment, 0, nrecvs, process_node_list, global_aggregator_size, global_aggregators, is_aggregator, recv_size, send_size, recv_buf, send_buf, setting, comm);
+    /* co = 1, 2, 4, ... and max_co last.*/
+    for ( co = 1; ; co *= 2 ){
+        if ( co > max_co ){
+            co = max_co;
+        }
+        failures += run_local_aggregators(rank, nprocs, type, rank_assignment, co, nrecvs, process_node_list, global_aggregator_size, global_aggregators, is_aggregator, recv_size, send_size, recv_buf, send_buf, setting, comm);
+        if ( co == max_co ){
+            break;
+        }
+    }
+
+    free(global_aggregators);
+    clean_up(nprocs, &recv_size, &send_size, &recv_buf, &send_buf);
+    return failures;
+}
+
+/*----< main() >-------------------------------------------------------------*/
+int main(int argc, char** argv){
+    int rank, nprocs, i, type = -1, rank_assignment = -1, max_co = 0, bad_option = 0, failures = 0, ra, t;
+    int *local_ranks, *global_receivers, *node_size, *process_node_list, nprocs_node, nrecvs;
+    Test_setting setting = {1, 1, 1, {1048576, 1, ACCESS_CONTIGUOUS, 0, 1, 1}};
+    MPI_Comm comm;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    /* command-line arguments */
+    while ((i = getopt(argc, argv, "hp:b:n:t:r:c:s:k:x:y:g:j:l:E:")) != EOF){
+        switch(i) {
+            case 'p': setting.nprocs_node = atoi(optarg);
+                      break;
+            case 'b': setting.blocklen = atoi(optarg);
+                      break;
+            case 'n': setting.ntimes = atoi(optarg);
+                      break;
+            case 't': type = atoi(optarg);
+                      break;
+            case 'r': rank_assignment = atoi(optarg);
+                      break;
+            case 'c': max_co = atoi(optarg);
+                      break;
+            case 's': setting.model.stripe_size = atoi(optarg);
+                      break;
+            case 'k': setting.model.stripe_count = atoi(optarg);
+                      break;
+            case 'x': setting.model.pattern = atoi(optarg);
+                      break;
+            case 'y': setting.model.nblocks = atoi(optarg);
+                      break;
+            case 'g': setting.model.cyclic = atoi(optarg);
+                      break;
+            case 'j': tam_injection_bandwidth = atof(optarg) * 1048576;
+                      break;
+            case 'l': tam_nic_bandwidth = atof(optarg) * 1048576;
+                      break;
+            case 'E': if (sscanf(optarg, "%lf,%lf", &net_emu_latency, &net_emu_bandwidth) < 1 || net_emu_latency < 0 || net_emu_bandwidth < 0){
+                          bad_option = 1;
+                      }
+                      net_emu_latency /= 1000000;
+                      net_emu_bandwidth *= 1048576;
+                      break;
+            case 'h':
+            default:  bad_option = 1;
+                      break;
+        }
+    }
+    if (bad_option || setting.nprocs_node < 1 || setting.blocklen < 1 || setting.ntimes < 1){
+        if (rank == 0) usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    setting.model.blocklen = setting.blocklen;
+    if ( max_co <= 0 ){
+        max_co = setting.nprocs_node;
+    }
+    if (net_emu_latency > 0 || net_emu_bandwidth > 0){
+        net_emulation_init(setting.nprocs_node);
+        if ( rank == 0 ){
+            printf("network emulation between nodes of %d processes: latency = %lf us, bandwidth per node = %lf MiB/s (0: unlimited)\n", setting.nprocs_node, net_emu_latency * 1000000, net_emu_bandwidth / 1048576);
+        }
+    }
+    if ( rank == 0 ){
+        printf("nprocs = %d, nprocs_node = %d, blocklen = %d, iterations = %d, largest co = %d\n", nprocs, setting.nprocs_node, setting.blocklen, setting.ntimes, max_co);
+    }
+    for ( ra = 0; ra <= 1; ra++ ){
+        if ( rank_assignment >= 0 && ra != rank_assignment ){
+            continue;
+        }
+        nprocs_node = setting.nprocs_node;
+        static_node_assignment(rank, nprocs, ra, &nprocs_node, &nrecvs, &node_size, &local_ranks, &global_receivers, &process_node_list);
+        MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+        if ( rank == 0 ){
+            printf("| method | type | assignment |   co |     time (s) | result\n");
+        }
+        for ( t = OST_STRIPE_SAME; t <= OST_STRIPE_MODEL; t++ ){
+            if ( type < 0 || t == type ){
+                failures += run_type(rank, nprocs, t, ra, max_co, nprocs_node, nrecvs, local_ranks, global_receivers, process_node_list, &setting, comm);
+            }
+        }
+        MPI_Comm_free(&comm);
+        free(node_size);
+        free(local_ranks);
+        free(global_receivers);
+        free(process_node_list);
+    }
+    if ( rank == 0 ){
+        printf("%d failed combinations\n", failures);
+    }
+    MPI_Finalize();
+    return failures ? 1 : 0;
+}